@@ -3,6 +3,7 @@ TARGET := app
 GLSLC := glslc
 
 SHADER_SOURCES := $(wildcard shader/*.vert) $(wildcard shader/*.frag) $(wildcard shader/*.comp) $(wildcard shader/*.mesh) $(wildcard shader/*.task)
+SHADER_HEADERS := $(wildcard shader/*.glsl)
 SHADER_OBJECTS := $(patsubst %.vert,%.spv,$(patsubst %.frag,%.spv,$(patsubst %.comp,%.spv,$(patsubst %.mesh,%.spv,$(patsubst %.task,%.spv,$(SHADER_SOURCES))))))
 
 GLSLFLAGS = --target-env=vulkan1.3
@@ -17,7 +18,7 @@ all: $(SHADER_OBJECTS)
 %.spv: %.frag Shaders.mk
 	$(GLSLC) $(GLSLFLAGS) $< -o $@
 
-%.spv: %.comp Shaders.mk
+%.spv: %.comp $(SHADER_HEADERS) Shaders.mk
 	$(GLSLC) $(GLSLFLAGS) $< -o $@
 
 %.spv: %.mesh Shaders.mk
@@ -0,0 +1,159 @@
+// Shared by mandelbrot_page.comp, mandelbrot_classify.comp and mandelbrot.comp, which are dispatched with the same descriptor set
+
+// Must match MANDELBROT_TILE_GROUPS in mandelbrot_management.h
+#define TILE_GROUPS 8u
+#define TILE_SIZE (TILE_GROUPS*8u)
+
+// Must match MANDELBROT_COLOR_FORMAT in mandelbrot_management.h
+layout(set = 0, binding = 0, rgba16f) uniform image2D color_image;
+layout(set = 0, binding = 1, std430) readonly buffer tile_buffer_t {
+    uvec2 tiles[];
+};
+// Written by the host while dispatches run, when it no longer matches the dispatch's generation the work is stale
+layout(set = 0, binding = 2, std430) coherent readonly buffer generation_buffer_t {
+    uint current_generation;
+};
+// Samples per pixel side of each tile, either 1, 2 or 4, in the low bits with the tile's place in the tile list above them
+// Must match MANDELBROT_RATE_BITS in mandelbrot_management.h
+#define RATE_BITS 3u
+#define RATE_MASK ((1u << RATE_BITS) - 1u)
+layout(set = 0, binding = 3, std430) readonly buffer rate_buffer_t {
+    uint rates[];
+};
+// The indirect dispatch of mandelbrot.comp followed by the tiles it runs over, must match mandelbrot_work_t in mandelbrot_management.h
+layout(set = 0, binding = 4, std430) buffer work_buffer_t {
+    uint num_work_groups_x;
+    uint num_work_groups_y;
+    uint num_work_groups_z;
+    uvec2 work_tiles[];
+};
+// This frame's entry of the parameter ring, written by the host before every tile chunk. Must match mandelbrot_compute_parameters_t in mandelbrot_management.h
+layout(set = 0, binding = 5, std140) uniform parameters_t {
+    // The indirect dispatch of mandelbrot_classify.comp
+    uvec3 num_classify_groups;
+    uint tile_offset;
+    mat3 affine_map;
+    uint generation;
+    uint sample_index;
+    // Sub pixel offset of this sample, samples after the first are averaged into what is already in the image
+    vec2 jitter;
+    // The part of the image the frame uses, the image itself is allocated with room to spare
+    uvec2 image_extent;
+    // The level of the pages that tiles are filled from, negative when they are not
+    int page_level;
+    // The indirect dispatch of mandelbrot_page.comp
+    uvec3 num_page_groups;
+};
+
+// Must match MANDELBROT_PAGE_SIZE, MANDELBROT_PAGE_ROOT_EXTENT, MANDELBROT_PAGE_ATLAS_PAGES and MANDELBROT_PAGE_TABLE_SIZE in mandelbrot_page_cache.h
+#define PAGE_SIZE 64u
+#define PAGE_ROOT_EXTENT 4.0
+#define PAGE_ATLAS_PAGES 64u
+#define PAGE_TABLE_SIZE (4u*PAGE_ATLAS_PAGES*PAGE_ATLAS_PAGES)
+
+// Iteration counts of every resident page, see get_iterations
+layout(set = 0, binding = 6, r32ui) uniform uimage2D page_atlas_image;
+struct page_table_entry_t {
+    int x;
+    int y;
+    uint level;
+    uint max_iterations;
+    uint slot;
+};
+// Open addressed by get_page_hash, written by the host while no chunk is in flight. Must match mandelbrot_page_table_entry_t in mandelbrot_page_cache.h
+layout(set = 0, binding = 7, std430) readonly buffer page_table_buffer_t {
+    page_table_entry_t page_table[];
+};
+struct page_request_t {
+    int x;
+    int y;
+    uint level;
+    uint slot;
+    uint uploaded;
+};
+// The pages mandelbrot_page.comp fills this chunk. Must match mandelbrot_page_request_t in mandelbrot_page_cache.h
+layout(set = 0, binding = 8, std430) readonly buffer page_request_buffer_t {
+    page_request_t page_requests[];
+};
+// PAGE_SIZE*PAGE_SIZE iteration counts per request, read for uploaded pages and written for computed ones which the host then keeps in the page file
+layout(set = 0, binding = 9, std430) buffer page_transfer_buffer_t {
+    uint page_transfers[];
+};
+
+// The iteration count of the first sample of every pixel, the render pipeline reconstructs along them. Must match MANDELBROT_ITERATION_FORMAT in mandelbrot_management.h
+layout(set = 0, binding = 10, r32ui) uniform writeonly uimage2D iteration_image;
+
+// Work of a frame that is no longer wanted is dropped midway
+bool is_stale() {
+    return current_generation != generation;
+}
+
+#include "mandelbrot_kernel.glsl"
+
+// Must match get_page_hash in mandelbrot_page_cache.c
+uint get_page_hash(ivec2 page, uint level) {
+    return ((uint(page.x)*73856093u) ^ (uint(page.y)*19349663u) ^ (level*83492791u) ^ (uint(MAX_ITERATIONS)*2654435761u)) & (PAGE_TABLE_SIZE - 1u);
+}
+
+// The atlas slot of a resident page, or ~0 if it is not
+uint find_page_slot(ivec2 page, uint level) {
+    uint index = get_page_hash(page, level);
+    for (uint i = 0u; i < PAGE_TABLE_SIZE; i++) {
+        page_table_entry_t entry = page_table[index];
+        if (entry.slot == ~0u) {
+            break;
+        }
+        if (entry.x == page.x && entry.y == page.y && entry.level == level && entry.max_iterations == uint(MAX_ITERATIONS)) {
+            return entry.slot;
+        }
+        index = (index + 1u) & (PAGE_TABLE_SIZE - 1u);
+    }
+    return ~0u;
+}
+
+float get_page_extent(uint level) {
+    return PAGE_ROOT_EXTENT / exp2(float(level));
+}
+
+// Pages are laid out row by row in the atlas, texels of a page go along with the complex plane
+ivec2 get_page_atlas_texel(uint slot, ivec2 texel) {
+    return ivec2(uvec2(slot % PAGE_ATLAS_PAGES, slot / PAGE_ATLAS_PAGES)*PAGE_SIZE) + texel;
+}
+
+uint get_tile_rate(uvec2 tile, ivec2 image_size) {
+    return rates[(tile.y*((uint(image_size.x) + TILE_SIZE - 1u)/TILE_SIZE)) + tile.x] & RATE_MASK;
+}
+
+// Where in the complex plane the sample of a rate by rate block of pixels starting at pixel is
+vec2 get_block_position(ivec2 pixel, uint rate, ivec2 image_size) {
+    vec2 sample_position = vec2(pixel) + 0.5*float(rate - 1u) + jitter*float(rate);
+    vec2 screen_position = 2.0*sample_position / vec2(image_size) - vec2(1.0, 1.0);
+    return (affine_map * vec3(screen_position, 1.0)).xy;
+}
+
+uint get_block_iterations(ivec2 pixel, uint rate, ivec2 image_size) {
+    return get_iterations(get_block_position(pixel, rate, image_size));
+}
+
+// Every pixel of the block holds the sample, mandelbrot_fragment.frag reconstructs between blocks
+// Only colors are averaged over samples, iteration counts stay those of the first
+void store_block_sample(ivec2 pixel, uint rate, ivec2 image_size, uint iterations) {
+    vec4 color = get_iterations_color(iterations);
+    for (int y = 0; y < int(rate); y++) {
+        for (int x = 0; x < int(rate); x++) {
+            ivec2 block_pixel = pixel + ivec2(x, y);
+            if (block_pixel.x >= image_size.x || block_pixel.y >= image_size.y) {
+                continue;
+            }
+
+            vec4 block_color = color;
+            if (sample_index > 0) {
+                block_color = mix(imageLoad(color_image, block_pixel), color, 1.0 / float(sample_index + 1));
+            } else {
+                imageStore(iteration_image, block_pixel, uvec4(iterations, 0u, 0u, 0u));
+            }
+
+            imageStore(color_image, block_pixel, block_color);
+        }
+    }
+}
@@ -1,11 +1,96 @@
 #version 460
 
 layout(set = 0, binding = 0) uniform sampler2D color_sampler;
+// Samples per pixel side of each tile, see mandelbrot.glsl
+layout(set = 0, binding = 1, std430) readonly buffer rate_buffer_t {
+    uint rates[];
+};
+// See mandelbrot_vertex.vert
+layout(set = 0, binding = 2, std140) uniform parameters_t {
+    mat3 affine_maps[2];
+    uvec4 image_extents;
+    uvec2 pending_tiles;
+};
+// Iteration counts of the first sample of every pixel, see mandelbrot.glsl
+layout(set = 0, binding = 3, r32ui) uniform readonly uimage2D iteration_image;
+// 0 for the front frame, 1 for the back frame which is clipped to what it covers, see mandelbrot_vertex.vert
+layout(push_constant, std430) uniform push_constants_t {
+    uint layer;
+};
 
 layout(location = 0) in vec2 texel_coord;
 
 layout(location = 0) out vec4 fragment_color;
 
+// Must match TILE_SIZE in mandelbrot.glsl
+#define TILE_SIZE 64
+// Must match RATE_BITS in mandelbrot.glsl
+#define RATE_BITS 3
+#define RATE_MASK ((1u << RATE_BITS) - 1u)
+// How quickly a texel stops contributing as its iteration count moves away from that of the nearest texel
+#define EDGE_SHARPNESS 2.0
+
+// Bilinear filtering guided by iteration counts, so that frames computed at a lower resolution or rate are upscaled without blurring across color bands
 void main() {
-    fragment_color = texture(color_sampler, texel_coord);
+    // Only the top left of the image is used, texel_coord spans just that part
+    ivec2 size = ivec2(layer == 0 ? image_extents.xy : image_extents.zw);
+
+    // Filtering happens between the blocks of the tile's rate, each of which holds a single sample
+    int num_tiles_x = (size.x + TILE_SIZE - 1)/TILE_SIZE;
+    ivec2 texel = clamp(ivec2(texel_coord*vec2(size)), ivec2(0, 0), size - ivec2(1, 1));
+    int rate = int(rates[((texel.y/TILE_SIZE)*num_tiles_x) + (texel.x/TILE_SIZE)] & RATE_MASK);
+
+    vec2 position = texel_coord*vec2(size)/float(rate) - vec2(0.5, 0.5);
+    ivec2 base = ivec2(floor(position));
+    vec2 fraction = position - vec2(base);
+
+    vec4 texels[4];
+    uint iterations[4];
+    float bilinear_weights[4] = float[4](
+        (1.0 - fraction.x)*(1.0 - fraction.y),
+        fraction.x*(1.0 - fraction.y),
+        (1.0 - fraction.x)*fraction.y,
+        fraction.x*fraction.y
+    );
+    for (int i = 0; i < 4; i++) {
+        ivec2 block_texel = clamp((base + ivec2(i & 1, i >> 1))*rate, ivec2(0, 0), size - ivec2(1, 1));
+
+        // The cpu workers may be writing these, they are treated as not computed without touching them
+        uint tile_position = rates[((block_texel.y/TILE_SIZE)*num_tiles_x) + (block_texel.x/TILE_SIZE)] >> RATE_BITS;
+        if (layer != 0 && tile_position >= pending_tiles.x && tile_position < pending_tiles.y) {
+            texels[i] = vec4(0.0, 0.0, 0.0, 0.0);
+            iterations[i] = 0u;
+            continue;
+        }
+
+        texels[i] = texelFetch(color_sampler, block_texel, 0);
+        iterations[i] = imageLoad(iteration_image, block_texel).x;
+    }
+
+    uint guide = iterations[int(fraction.x >= 0.5) + 2*int(fraction.y >= 0.5)];
+
+    // Alpha is zero where the frame has not been computed yet, those texels are left out and make the fragment see through
+    vec3 color = vec3(0.0, 0.0, 0.0);
+    float total_weight = 0.0;
+    float coverage = 0.0;
+    for (int i = 0; i < 4; i++) {
+        if (texels[i].a == 0.0) {
+            continue;
+        }
+        coverage += bilinear_weights[i];
+
+        float weight = bilinear_weights[i];
+        if (guide != 0u) {
+            weight *= exp(-EDGE_SHARPNESS*abs(float(iterations[i]) - float(guide)));
+        }
+        color += weight*texels[i].rgb;
+        total_weight += weight;
+    }
+
+    fragment_color = vec4(total_weight > 0.0 ? color/total_weight : color, coverage);
+
+    // Frames drawn over another frame must not smear their edges over it
+    if (layer != 0 && (any(lessThan(texel_coord, vec2(0.0))) || any(greaterThan(texel_coord, vec2(1.0))))) {
+        fragment_color.a = 0.0;
+    }
 }
\ No newline at end of file
@@ -1,15 +1,24 @@
 #version 460
 
+// This frame's entry of the parameter ring. Must match parameters_t in mandelbrot_render_pipeline.c
+layout(set = 0, binding = 2, std140) uniform parameters_t {
+    // Tween maps of the front and back frames
+    mat3 affine_maps[2];
+    // The parts of their images the front and back frames use, in xy and zw
+    uvec4 image_extents;
+    // Positions in the tile list of the back frame's tiles the cpu workers may be writing, see mandelbrot_fragment.frag
+    uvec2 pending_tiles;
+};
 layout(push_constant, std430) uniform push_constants_t {
-    mat3 affine_map;
+    uint layer;
 };
 
-layout(location = 0) in vec2 vertex_position;
-
 layout(location = 0) out vec2 texel_coord;
 
+// A single triangle that covers the whole screen, generated from the vertex index so that there is no vertex buffer
 void main() {
+    vec2 vertex_position = vec2(gl_VertexIndex == 2 ? 3.0 : -1.0, gl_VertexIndex == 1 ? 3.0 : -1.0);
     gl_Position = vec4(vertex_position, 0.0, 1.0);
 
-    texel_coord = 0.5*((affine_map * vec3(vertex_position, 1.0)).xy + vec2(1.0, 1.0));
+    texel_coord = 0.5*((affine_maps[layer] * vec3(vertex_position, 1.0)).xy + vec2(1.0, 1.0));
 }
\ No newline at end of file
@@ -5,32 +5,114 @@
 #include <cglm/struct/mat3.h>
 #include <cglm/struct/affine2d.h>
 #include <cglm/util.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <threads.h>
 
+#define EASE_RATE 24.0f
+// In pixels
+#define CAMERA_STILL_TOLERANCE 0.0625f
+
+// Set on the middle snapshot index once the input thread has put a snapshot there that the render thread has not latched yet
+#define SNAPSHOT_FRESH_BIT 4u
+
+// Everything the render thread reads about the camera, copied out by the input thread every update
+typedef struct {
+    camera_scale_t current_scale;
+    extended_t current_center[2];
+    camera_scale_t target_scale;
+    extended_t target_center[2];
+    int framebuffer_width;
+    int framebuffer_height;
+    bool in_movement_mode;
+    bool has_cursor_position;
+    vec2s cursor_position;
+    float edge_speed;
+    bool still;
+} camera_snapshot_t;
+
+// Only touched by the input thread
 static bool in_movement_mode;
 static vec2s movement_mode_last_cursor_position = {{ 0.0f, 0.0f }};
 
-static float target_scale_factor = 1.0f;
-static vec2s target_offset = {{ 0.0f, 0.0f }};
+// Both start out at a scale of one around the origin
+static camera_scale_t target_scale = { 0.5, 1 };
+static extended_t target_center[2];
+
+static camera_scale_t current_scale = { 0.5, 1 };
+static extended_t current_center[2];
+
+// How fast, in pixels per second, the edges of the view have recently been moving over the fractal
+static float edge_speed = 0.0f;
+
+// Triple buffered, the input thread fills the back snapshot and swaps it with the middle one, the render thread swaps the middle one with the front one whenever it is fresh. Neither side ever waits on the other
+static camera_snapshot_t snapshots[3];
+static uint32_t back_snapshot_index = 0;
+static _Atomic(uint32_t) middle_snapshot_index = 1;
+static uint32_t front_snapshot_index = 2;
+
+// Only for blocking the render thread while it has nothing to do, snapshots themselves never take the lock
+static mtx_t wait_mutex;
+static cnd_t wait_condition;
+static bool waits_released = false;
+
+// When the oldest input event that no frame has shown yet arrived, or 0 if there is none. Stamped by the input thread and taken by the render thread
+static _Atomic(microseconds_t) pending_input_time = 0;
+
+static camera_scale_t make_camera_scale(double mantissa, int32_t exponent) {
+    int mantissa_exponent;
+    mantissa = frexp(mantissa, &mantissa_exponent);
+    return (camera_scale_t) { mantissa, exponent + mantissa_exponent };
+}
+
+// The ratio of two scales, which is always moderate even where the scales themselves are not
+static double get_camera_scale_ratio(camera_scale_t scale, camera_scale_t other_scale) {
+    return ldexp(scale.mantissa / other_scale.mantissa, scale.exponent - other_scale.exponent);
+}
+
+static double get_camera_scale_double(camera_scale_t scale) {
+    return ldexp(scale.mantissa, scale.exponent);
+}
+
+// A difference of centers in units of the scale, only the difference has to fit in a double
+static double get_scaled_distance(const extended_t center[2], const extended_t other_center[2], camera_scale_t scale) {
+    double distance = hypot(get_extended_double(sub_extended(center[0], other_center[0])), get_extended_double(sub_extended(center[1], other_center[1])));
+    return ldexp(distance / scale.mantissa, -scale.exponent);
+}
 
-static float current_scale_factor = 1.0f;
-static vec2s current_offset = {{ 0.0f, 0.0f }};
+static void stamp_input(void) {
+    microseconds_t expected_input_time = 0;
+    atomic_compare_exchange_strong(&pending_input_time, &expected_input_time, get_current_microseconds());
+}
 
 static void scroll(GLFWwindow*, double, double factor) {
-    float scale_factor = 0.5f + (0.5f*(1.0f - ((float) factor)));
-    target_scale_factor *= scale_factor;
+    double scale_factor = 0.5 + (0.5*(1.0 - factor));
+    target_scale = make_camera_scale(target_scale.mantissa * scale_factor, target_scale.exponent);
+    stamp_input();
 }
 
-static bool is_cursor_position_out_of_bounds(vec2s cursor_position) {
-    int width;
-    int height;
-    glfwGetFramebufferSize(window, &width, &height);
+// Only timestamped, the position itself is polled by update_camera
+static void cursor_move(GLFWwindow*, double, double) {
+    if (in_movement_mode) {
+        stamp_input();
+    }
+}
+
+static void mouse_button(GLFWwindow*, int button, int, int) {
+    if (button == GLFW_MOUSE_BUTTON_1) {
+        stamp_input();
+    }
+}
+
+static bool is_cursor_position_out_of_bounds(vec2s cursor_position, int width, int height) {
     return cursor_position.x < 0.0f || cursor_position.x >= (float) width || cursor_position.y < 0.0f || cursor_position.y >= (float) height;
 }
 
-static vec2s get_offset(void) {
+static vec2s get_offset(int width, int height) {
     int mouse_button = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1);
-    
+
     if (in_movement_mode && mouse_button != GLFW_PRESS) {
         in_movement_mode = false;
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
@@ -42,7 +124,7 @@ static vec2s get_offset(void) {
         glfwGetCursorPos(window, &cursor_x, &cursor_y);
 
         const vec2s cursor_position = {{ (float)cursor_x, (float)cursor_y }};
-        if (is_cursor_position_out_of_bounds(cursor_position)) {
+        if (is_cursor_position_out_of_bounds(cursor_position, width, height)) {
             return (vec2s) {{ 0.0f, 0.0f }};
         }
 
@@ -68,34 +150,233 @@ static vec2s get_offset(void) {
     return offset;
 }
 
-void init_camera(void) {
-    glfwSetScrollCallback(window, scroll);
+static void update_edge_speed(float delta, camera_scale_t previous_scale, const extended_t previous_center[2], int width, int height) {
+    if (delta <= 0.0f) {
+        return;
+    }
+
+    // Centers are in units of half the framebuffer height at the current scale
+    float pan_distance = (float) get_scaled_distance(current_center, previous_center, current_scale) * 0.5f * (float) height;
+    // Zooming out pulls new content in over the edges, the corners move the farthest
+    float zoom_out_distance = glm_max((float) get_camera_scale_ratio(current_scale, previous_scale) - 1.0f, 0.0f) * 0.5f * sqrtf((float) ((width * width) + (height * height)));
+
+    float smoothing_time = 4.0f * delta;
+    if (smoothing_time > 1.0f) { smoothing_time = 1.0f; }
+    edge_speed = glm_lerp(edge_speed, (pan_distance + zoom_out_distance) / delta, smoothing_time);
 }
 
-void update_camera(float delta) {
-    target_offset = glms_vec2_add(target_offset, glms_vec2_scale(get_offset(), current_scale_factor));
+// Settled once the easing is within a fraction of a pixel of its target, from there on the view no longer visibly changes
+static bool is_still(int width, int height) {
+    if (in_movement_mode || atomic_load(&pending_input_time) != 0) {
+        return false;
+    }
 
-    float lerp_time = 24.0f * delta;
-    if (lerp_time > 1.0f) { lerp_time = 1.0f; }
-    current_scale_factor = glm_lerp(current_scale_factor, target_scale_factor, lerp_time);
-    current_offset = glms_vec2_lerp(current_offset, target_offset, lerp_time);
+    // Centers are in units of half the framebuffer height at the current scale, like in update_edge_speed
+    float pan_distance = (float) get_scaled_distance(current_center, target_center, current_scale) * 0.5f * (float) height;
+    float zoom_distance = fabsf((float) get_camera_scale_ratio(target_scale, current_scale) - 1.0f) * 0.5f * sqrtf((float) ((width * width) + (height * height)));
+    return pan_distance < CAMERA_STILL_TOLERANCE && zoom_distance < CAMERA_STILL_TOLERANCE;
 }
 
-static mat3s get_preaspect_affine_map(float scale_factor, vec2s offset) {
-    mat3s scale_affine_map = glms_scale2d_make((vec2s) {{ scale_factor, scale_factor }});
-    mat3s translate_affine_map = glms_translate2d_make(offset);
-    return glms_mat3_mul(translate_affine_map, scale_affine_map);
+static bool publish_snapshot(int width, int height) {
+    camera_snapshot_t* snapshot = &snapshots[back_snapshot_index];
+    *snapshot = (camera_snapshot_t) {
+        .current_scale = current_scale,
+        .current_center = { current_center[0], current_center[1] },
+        .target_scale = target_scale,
+        .target_center = { target_center[0], target_center[1] },
+        .framebuffer_width = width,
+        .framebuffer_height = height,
+        .in_movement_mode = in_movement_mode,
+        .edge_speed = edge_speed,
+        .still = is_still(width, height)
+    };
+
+    if (!in_movement_mode) {
+        double cursor_x;
+        double cursor_y;
+        glfwGetCursorPos(window, &cursor_x, &cursor_y);
+
+        snapshot->cursor_position = (vec2s) {{ (float)cursor_x, (float)cursor_y }};
+        snapshot->has_cursor_position = !is_cursor_position_out_of_bounds(snapshot->cursor_position, width, height);
+    }
+
+    back_snapshot_index = atomic_exchange(&middle_snapshot_index, back_snapshot_index | SNAPSHOT_FRESH_BIT) & ~SNAPSHOT_FRESH_BIT;
+
+    // Taken after the swap, so a render thread that saw no fresh snapshot is already waiting and gets the signal
+    mtx_lock(&wait_mutex);
+    cnd_signal(&wait_condition);
+    mtx_unlock(&wait_mutex);
+
+    return snapshot->still;
 }
 
-mat3s get_affine_map() {
-    mat3s current_affine_map = get_preaspect_affine_map(current_scale_factor, current_offset);
+// Called on the input thread, which is the main thread since GLFW only handles events there. Publishes the first snapshot and latches it for the rest of initialization
+result_t init_camera(void) {
+    if (mtx_init(&wait_mutex, mtx_plain) != thrd_success || cnd_init(&wait_condition) != thrd_success) {
+        return result_synchronization_primitive_create_failure;
+    }
+
+    glfwSetScrollCallback(window, scroll);
+    glfwSetCursorPosCallback(window, cursor_move);
+    glfwSetMouseButtonCallback(window, mouse_button);
+
+    int width;
+    int height;
+    glfwGetFramebufferSize(window, &width, &height);
+    publish_snapshot(width, height);
+    latch_camera();
+
+    return result_success;
+}
 
+// Dragging skips the easing so that the view follows the cursor exactly, returns whether the camera is still
+bool update_camera(float delta) {
     int width;
     int height;
     glfwGetFramebufferSize(window, &width, &height);
-    mat3s aspect_affine_map = glms_scale2d_make((vec2s) {{ (float) width / (float) height, 1.0f }});
 
-    mat3s affine_map = glms_mat3_mul(current_affine_map, aspect_affine_map);
+    camera_scale_t previous_scale = current_scale;
+    extended_t previous_center[2] = { current_center[0], current_center[1] };
 
-    return affine_map;
-}
\ No newline at end of file
+    vec2s offset = get_offset(width, height);
+    for (size_t i = 0; i < 2; i++) {
+        double drag_offset = ldexp((double) offset.raw[i] * current_scale.mantissa, current_scale.exponent);
+        target_center[i] = add_extended_double(target_center[i], drag_offset);
+        current_center[i] = add_extended_double(current_center[i], drag_offset);
+    }
+
+    // Eased by their ratio and difference so that neither the depth nor the distance from the origin costs precision
+    double lerp_time = EASE_RATE * (double) delta;
+    if (lerp_time > 1.0) { lerp_time = 1.0; }
+    current_scale = make_camera_scale(current_scale.mantissa * (1.0 + ((get_camera_scale_ratio(target_scale, current_scale) - 1.0) * lerp_time)), current_scale.exponent);
+    for (size_t i = 0; i < 2; i++) {
+        current_center[i] = add_extended_double(current_center[i], get_extended_double(sub_extended(target_center[i], current_center[i])) * lerp_time);
+    }
+
+    update_edge_speed(delta, previous_scale, previous_center, width, height);
+
+    return publish_snapshot(width, height);
+}
+
+// Everything below is called on the render thread and reads the snapshot latched last
+
+// Takes the most recent snapshot, called right before the affine map is handed to the gpu so that the most recent cursor movement makes it in
+void latch_camera(void) {
+    if (atomic_load(&middle_snapshot_index) & SNAPSHOT_FRESH_BIT) {
+        front_snapshot_index = atomic_exchange(&middle_snapshot_index, front_snapshot_index) & ~SNAPSHOT_FRESH_BIT;
+    }
+}
+
+// Blocks until there is a snapshot that has not been latched yet, or for good once release_camera_waits was called
+void wait_camera(void) {
+    mtx_lock(&wait_mutex);
+    while (!(atomic_load(&middle_snapshot_index) & SNAPSHOT_FRESH_BIT) && !waits_released) {
+        cnd_wait(&wait_condition, &wait_mutex);
+    }
+    mtx_unlock(&wait_mutex);
+}
+
+// For shutting down, called on the input thread
+void release_camera_waits(void) {
+    mtx_lock(&wait_mutex);
+    waits_released = true;
+    cnd_broadcast(&wait_condition);
+    mtx_unlock(&wait_mutex);
+}
+
+bool is_camera_still(void) {
+    return snapshots[front_snapshot_index].still;
+}
+
+microseconds_t take_camera_input_time(void) {
+    return atomic_exchange(&pending_input_time, 0);
+}
+
+void get_camera_framebuffer_size(int* out_width, int* out_height) {
+    *out_width = snapshots[front_snapshot_index].framebuffer_width;
+    *out_height = snapshots[front_snapshot_index].framebuffer_height;
+}
+
+static camera_view_t make_camera_view(camera_scale_t scale, const extended_t center[2]) {
+    int width;
+    int height;
+    get_camera_framebuffer_size(&width, &height);
+
+    return (camera_view_t) {
+        .center = { center[0], center[1] },
+        .scale = scale,
+        .aspect = (double) width / (double) height
+    };
+}
+
+// Eases from the first state toward the second the same way update_camera does, where 0 is the first and 1 the second
+static camera_view_t lerp_camera_view(camera_scale_t scale, const extended_t center[2], camera_scale_t other_scale, const extended_t other_center[2], double time) {
+    camera_view_t view = make_camera_view(make_camera_scale(scale.mantissa * (1.0 + ((get_camera_scale_ratio(other_scale, scale) - 1.0) * time)), scale.exponent), center);
+    for (size_t i = 0; i < 2; i++) {
+        view.center[i] = add_extended_double(center[i], get_extended_double(sub_extended(other_center[i], center[i])) * time);
+    }
+    return view;
+}
+
+camera_view_t get_camera_view(void) {
+    const camera_snapshot_t* snapshot = &snapshots[front_snapshot_index];
+    return make_camera_view(snapshot->current_scale, snapshot->current_center);
+}
+
+camera_view_t get_predicted_camera_view(camera_prediction_t prediction, microseconds_t latency) {
+    const camera_snapshot_t* snapshot = &snapshots[front_snapshot_index];
+    switch (prediction) {
+        case camera_prediction_latency: {
+            // Continuous form of the per update easing in update_camera
+            double remaining = exp(-EASE_RATE * ((double) latency / 1000000.0));
+            return lerp_camera_view(snapshot->target_scale, snapshot->target_center, snapshot->current_scale, snapshot->current_center, remaining);
+        }
+        case camera_prediction_target: return make_camera_view(snapshot->target_scale, snapshot->target_center);
+        default: return get_camera_view();
+    }
+}
+
+mat3s get_camera_view_affine_map(const camera_view_t* view) {
+    float scale = (float) get_camera_scale_double(view->scale);
+    mat3s scale_affine_map = glms_scale2d_make((vec2s) {{ scale * (float) view->aspect, scale }});
+    mat3s translate_affine_map = glms_translate2d_make((vec2s) {{ (float) get_extended_double(view->center[0]), (float) get_extended_double(view->center[1]) }});
+    return glms_mat3_mul(translate_affine_map, scale_affine_map);
+}
+
+void get_camera_view_double_affine_map(const camera_view_t* view, double out_affine_map[3][2]) {
+    double scale = get_camera_scale_double(view->scale);
+    out_affine_map[0][0] = scale * view->aspect;
+    out_affine_map[0][1] = 0.0;
+    out_affine_map[1][0] = 0.0;
+    out_affine_map[1][1] = scale;
+    out_affine_map[2][0] = get_extended_double(view->center[0]);
+    out_affine_map[2][1] = get_extended_double(view->center[1]);
+}
+
+mat3s get_camera_tween_affine_map(const camera_view_t* reference, const camera_view_t* view) {
+    double ratio = get_camera_scale_ratio(view->scale, reference->scale);
+    mat3s scale_affine_map = glms_scale2d_make((vec2s) {{ (float) (ratio * view->aspect / reference->aspect), (float) ratio }});
+
+    double offset_x = get_extended_double(sub_extended(view->center[0], reference->center[0]));
+    double offset_y = get_extended_double(sub_extended(view->center[1], reference->center[1]));
+    mat3s translate_affine_map = glms_translate2d_make((vec2s) {{
+        (float) ldexp(offset_x / (reference->scale.mantissa * reference->aspect), -reference->scale.exponent),
+        (float) ldexp(offset_y / reference->scale.mantissa, -reference->scale.exponent)
+    }});
+
+    return glms_mat3_mul(translate_affine_map, scale_affine_map);
+}
+
+bool get_cursor_position(vec2s* out_cursor_position) {
+    const camera_snapshot_t* snapshot = &snapshots[front_snapshot_index];
+    if (snapshot->in_movement_mode || !snapshot->has_cursor_position) {
+        return false;
+    }
+
+    *out_cursor_position = snapshot->cursor_position;
+    return true;
+}
+
+float get_camera_edge_speed(void) {
+    return snapshots[front_snapshot_index].edge_speed;
+}
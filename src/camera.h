@@ -1,6 +1,54 @@
 #pragma once
+#include "chrono.h"
+#include "extended.h"
+#include "result.h"
 #include <cglm/types-struct.h>
+#include <stdbool.h>
+#include <stdint.h>
 
-void init_camera(void);
-void update_camera(float delta);
-mat3s get_affine_map();
\ No newline at end of file
+typedef enum {
+    // The eased state the camera is in right now
+    camera_prediction_none,
+    // Where the easing will have taken the camera after some latency
+    camera_prediction_latency,
+    // Where the easing is heading
+    camera_prediction_target
+} camera_prediction_t;
+
+// A mantissa in [0.5, 1) and a power of two, zooming changes the exponent rather than wearing the mantissa down so the scale can neither underflow nor drift
+typedef struct {
+    double mantissa;
+    int32_t exponent;
+} camera_scale_t;
+
+// Normalized coordinates x map onto the complex plane at center + scale*(aspect*x.x, x.y)
+typedef struct {
+    extended_t center[2];
+    camera_scale_t scale;
+    double aspect;
+} camera_view_t;
+
+// Input thread
+result_t init_camera(void);
+bool update_camera(float delta);
+void release_camera_waits(void);
+
+// Render thread, everything from here on reads the snapshot latched last
+void latch_camera(void);
+void wait_camera(void);
+bool is_camera_still(void);
+// The time of the oldest input event since the last call, or 0 if there was none
+microseconds_t take_camera_input_time(void);
+void get_camera_framebuffer_size(int* out_width, int* out_height);
+camera_view_t get_camera_view(void);
+camera_view_t get_predicted_camera_view(camera_prediction_t prediction, microseconds_t latency);
+bool get_cursor_position(vec2s* out_cursor_position);
+float get_camera_edge_speed(void);
+
+// Affine maps of views, only these ever lose precision
+// In the complex plane as floats, which is all the gpu kernels work with
+mat3s get_camera_view_affine_map(const camera_view_t* view);
+// In the complex plane as doubles, columns of two since the last row is always the same
+void get_camera_view_double_affine_map(const camera_view_t* view, double out_affine_map[3][2]);
+// From the normalized coordinates of view to those of reference, the difference of the views is taken in full precision so it holds at any zoom
+mat3s get_camera_tween_affine_map(const camera_view_t* reference, const camera_view_t* view);
\ No newline at end of file
@@ -1,14 +1,16 @@
+// nanosleep is POSIX rather than C, it has to be asked for before any system header
+#define _POSIX_C_SOURCE 200809L
 #include "chrono.h"
+#include <GLFW/glfw3.h>
+#include <stdint.h>
 #include <time.h>
-#include <sys/time.h>
 #include <unistd.h>
 
-int nanosleep(const struct timespec* req, struct timespec* rem);
-
+// Monotonic unlike the wall clock, which can jump, and split up so that nanosecond timer values do not overflow when scaled
 microseconds_t get_current_microseconds() {
-    struct timeval cur_time;
-	gettimeofday(&cur_time, NULL);
-	return (cur_time.tv_sec * 1000000l) + cur_time.tv_usec;
+    uint64_t value = glfwGetTimerValue();
+    uint64_t frequency = glfwGetTimerFrequency();
+    return (microseconds_t) (((value / frequency) * 1000000ul) + (((value % frequency) * 1000000ul) / frequency));
 }
 
 void sleep_microseconds(microseconds_t time) {
@@ -0,0 +1,32 @@
+#pragma once
+
+// Double-double, the unevaluated sum of two doubles which together hold about 106 bits of mantissa
+typedef struct {
+    double hi;
+    double lo;
+} extended_t;
+
+inline extended_t make_extended(double value) {
+    return (extended_t) { value, 0.0 };
+}
+
+// The rounding error of the sum of the high parts is recovered exactly (Knuth's two-sum) and carried in the low part
+inline extended_t add_extended(extended_t a, extended_t b) {
+    double sum = a.hi + b.hi;
+    double b_part = sum - a.hi;
+    double error = (a.hi - (sum - b_part)) + (b.hi - b_part) + a.lo + b.lo;
+    double hi = sum + error;
+    return (extended_t) { hi, error - (hi - sum) };
+}
+
+inline extended_t sub_extended(extended_t a, extended_t b) {
+    return add_extended(a, (extended_t) { -b.hi, -b.lo });
+}
+
+inline extended_t add_extended_double(extended_t a, double b) {
+    return add_extended(a, make_extended(b));
+}
+
+inline double get_extended_double(extended_t value) {
+    return value.hi + value.lo;
+}
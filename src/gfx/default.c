@@ -25,6 +25,22 @@ const VkPipelineColorBlendStateCreateInfo default_color_blend_create_info = {
     }
 };
 
+const VkPipelineColorBlendStateCreateInfo default_alpha_blend_create_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+    .logicOpEnable = VK_FALSE,
+    .attachmentCount = 1,
+    .pAttachments = &(VkPipelineColorBlendAttachmentState) {
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+        .blendEnable = VK_TRUE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+        .alphaBlendOp = VK_BLEND_OP_ADD
+    }
+};
+
 const VkPipelineDynamicStateCreateInfo default_dynamic_create_info = {
     .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
     .dynamicStateCount = 2,
@@ -57,6 +73,27 @@ const VmaAllocationCreateInfo shared_read_allocation_create_info = {
     .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
 };
 
+// Stays mapped for its whole lifetime, the pointer is in VmaAllocationInfo::pMappedData
+const VmaAllocationCreateInfo mapped_shared_write_allocation_create_info = {
+    DEFAULT_VMA_ALLOCATION,
+    .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+};
+
+// Same as above for memory the host reads back
+const VmaAllocationCreateInfo mapped_shared_read_allocation_create_info = {
+    DEFAULT_VMA_ALLOCATION,
+    .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+};
+
+// Mapped for the host to write into while the device works with it as its own, only device local memory that is host visible too as on integrated gpus and over a resizable BAR
+const VmaAllocationCreateInfo mapped_device_write_allocation_create_info = {
+    DEFAULT_VMA_ALLOCATION,
+    .flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+};
+
 const VmaAllocationCreateInfo device_allocation_create_info = {
     DEFAULT_VMA_ALLOCATION,
     .requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
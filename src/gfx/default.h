@@ -4,6 +4,7 @@
 extern const VkPipelineInputAssemblyStateCreateInfo default_input_assembly_create_info;
 extern const VkPipelineViewportStateCreateInfo default_viewport_create_info;
 extern const VkPipelineColorBlendStateCreateInfo default_color_blend_create_info;
+extern const VkPipelineColorBlendStateCreateInfo default_alpha_blend_create_info;
 extern const VkPipelineDynamicStateCreateInfo default_dynamic_create_info;
 
 extern const VkBufferCreateInfo vertex_buffer_create_info;
@@ -11,6 +12,9 @@ extern const VkBufferCreateInfo index_buffer_create_info;
 extern const VkBufferCreateInfo uniform_buffer_create_info;
 extern const VmaAllocationCreateInfo shared_write_allocation_create_info;
 extern const VmaAllocationCreateInfo shared_read_allocation_create_info;
+extern const VmaAllocationCreateInfo mapped_shared_write_allocation_create_info;
+extern const VmaAllocationCreateInfo mapped_shared_read_allocation_create_info;
+extern const VmaAllocationCreateInfo mapped_device_write_allocation_create_info;
 extern const VmaAllocationCreateInfo device_allocation_create_info;
 
 #define DEFAULT_VK_COMMAND_BUFFER\
@@ -87,6 +91,10 @@ extern const VmaAllocationCreateInfo device_allocation_create_info;
     DEFAULT_VK_BUFFER,\
     .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
 
+#define DEFAULT_VK_STORAGE_BUFFER\
+    DEFAULT_VK_BUFFER,\
+    .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+
 #define DEFAULT_VMA_ALLOCATION\
     .usage = VMA_MEMORY_USAGE_AUTO
 
@@ -0,0 +1,270 @@
+#include "frame_graph.h"
+#include "util.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#define FRAME_GRAPH_MAX_BARRIERS (FRAME_GRAPH_MAX_PASSES*FRAME_GRAPH_MAX_PASS_ACCESSES)
+
+// The passes that read a resource are kept in a bit mask
+static_assert(FRAME_GRAPH_MAX_PASSES <= 32, "read_pass_masks has a bit per pass");
+
+#define WRITE_ACCESS_FLAGS (VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT)
+
+typedef struct {
+    uint32_t num_memory_barriers;
+    VkMemoryBarrier2 memory_barriers[FRAME_GRAPH_MAX_BARRIERS];
+    uint32_t num_buffer_barriers;
+    VkBufferMemoryBarrier2 buffer_barriers[FRAME_GRAPH_MAX_BARRIERS];
+    uint32_t num_image_barriers;
+    VkImageMemoryBarrier2 image_barriers[FRAME_GRAPH_MAX_BARRIERS];
+} barrier_batch_t;
+
+static bool is_write_access(VkAccessFlags2 access_flags) {
+    return (access_flags & WRITE_ACCESS_FLAGS) != 0;
+}
+
+// A layout transition writes the image as far as synchronization is concerned
+static bool is_writing_access(const frame_graph_resource_t* resource, const frame_graph_access_t* access, VkImageLayout layout) {
+    return is_write_access(access->usage.access_flags) || access->discard || (resource->type == frame_graph_resource_image && access->usage.layout != layout);
+}
+
+void init_frame_graph(frame_graph_t* graph) {
+    graph->num_resources = 0;
+    graph->num_passes = 0;
+}
+
+static uint32_t add_frame_graph_resource(frame_graph_t* graph, frame_graph_resource_t resource) {
+    const frame_graph_usage_t* initial_usage = &resource.initial_usage;
+    if (is_write_access(initial_usage->access_flags)) {
+        resource.write_usage = (frame_graph_usage_t) { initial_usage->stage_flags, initial_usage->access_flags & WRITE_ACCESS_FLAGS, initial_usage->layout };
+        resource.read_stage_flags = VK_PIPELINE_STAGE_2_NONE;
+        resource.read_access_flags = VK_ACCESS_2_NONE;
+    } else {
+        resource.write_usage = (frame_graph_usage_t) { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, initial_usage->layout };
+        resource.read_stage_flags = initial_usage->stage_flags;
+        resource.read_access_flags = initial_usage->access_flags;
+    }
+    resource.layout = initial_usage->layout;
+
+    assert(graph->num_resources < FRAME_GRAPH_MAX_RESOURCES);
+    uint32_t index = graph->num_resources++;
+    graph->resources[index] = resource;
+    return index;
+}
+
+uint32_t add_frame_graph_memory(frame_graph_t* graph, const frame_graph_usage_t* initial_usage) {
+    return add_frame_graph_resource(graph, (frame_graph_resource_t) {
+        .type = frame_graph_resource_memory,
+        .initial_usage = *initial_usage
+    });
+}
+
+uint32_t add_frame_graph_buffer(frame_graph_t* graph, VkBuffer buffer, const frame_graph_usage_t* initial_usage) {
+    return add_frame_graph_resource(graph, (frame_graph_resource_t) {
+        .type = frame_graph_resource_buffer,
+        .buffer = buffer,
+        .initial_usage = *initial_usage
+    });
+}
+
+uint32_t add_frame_graph_image(frame_graph_t* graph, VkImage image, uint32_t num_layers, const frame_graph_usage_t* initial_usage) {
+    return add_frame_graph_resource(graph, (frame_graph_resource_t) {
+        .type = frame_graph_resource_image,
+        .image = image,
+        .num_layers = num_layers,
+        .initial_usage = *initial_usage
+    });
+}
+
+void add_frame_graph_pass(frame_graph_t* graph, frame_graph_record_t record, const void* data, uint32_t num_accesses, const frame_graph_access_t accesses[]) {
+    assert(graph->num_passes < FRAME_GRAPH_MAX_PASSES && num_accesses <= FRAME_GRAPH_MAX_PASS_ACCESSES);
+    frame_graph_pass_t* pass = &graph->passes[graph->num_passes++];
+    pass->record = record;
+    pass->data = data;
+    pass->num_accesses = num_accesses;
+    for (size_t i = 0; i < num_accesses; i++) {
+        pass->accesses[i] = accesses[i];
+    }
+}
+
+// A pass goes one level after the last pass that wrote what it accesses, and if it writes, one level after every pass that read it since
+static uint32_t get_frame_graph_pass_levels(const frame_graph_t* graph, uint32_t levels[]) {
+    uint32_t last_write_passes[FRAME_GRAPH_MAX_RESOURCES];
+    uint32_t read_pass_masks[FRAME_GRAPH_MAX_RESOURCES];
+    VkImageLayout layouts[FRAME_GRAPH_MAX_RESOURCES];
+    for (size_t i = 0; i < graph->num_resources; i++) {
+        last_write_passes[i] = NULL_UINT32;
+        read_pass_masks[i] = 0;
+        layouts[i] = graph->resources[i].initial_usage.layout;
+    }
+
+    uint32_t num_levels = 0;
+    for (uint32_t i = 0; i < graph->num_passes; i++) {
+        const frame_graph_pass_t* pass = &graph->passes[i];
+
+        uint32_t level = 0;
+        for (size_t j = 0; j < pass->num_accesses; j++) {
+            const frame_graph_access_t* access = &pass->accesses[j];
+            uint32_t resource_index = access->resource_index;
+
+            if (last_write_passes[resource_index] != NULL_UINT32) {
+                level = max_uint32(level, levels[last_write_passes[resource_index]] + 1);
+            }
+            if (is_writing_access(&graph->resources[resource_index], access, layouts[resource_index])) {
+                for (uint32_t k = 0; k < i; k++) {
+                    if (read_pass_masks[resource_index] & (1u << k)) {
+                        level = max_uint32(level, levels[k] + 1);
+                    }
+                }
+            }
+        }
+        levels[i] = level;
+        num_levels = max_uint32(num_levels, level + 1);
+
+        for (size_t j = 0; j < pass->num_accesses; j++) {
+            const frame_graph_access_t* access = &pass->accesses[j];
+            uint32_t resource_index = access->resource_index;
+
+            if (is_writing_access(&graph->resources[resource_index], access, layouts[resource_index])) {
+                last_write_passes[resource_index] = i;
+                read_pass_masks[resource_index] = 0;
+                layouts[resource_index] = access->usage.layout;
+            } else {
+                read_pass_masks[resource_index] |= 1u << i;
+            }
+        }
+    }
+
+    return num_levels;
+}
+
+static void add_barrier(barrier_batch_t* batch, const frame_graph_resource_t* resource, VkPipelineStageFlags2 src_stage_flags, VkAccessFlags2 src_access_flags, const frame_graph_usage_t* dst_usage, VkImageLayout old_layout) {
+    switch (resource->type) {
+        case frame_graph_resource_memory: {
+            batch->memory_barriers[batch->num_memory_barriers++] = (VkMemoryBarrier2) {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                .srcStageMask = src_stage_flags,
+                .srcAccessMask = src_access_flags,
+                .dstStageMask = dst_usage->stage_flags,
+                .dstAccessMask = dst_usage->access_flags
+            };
+        } break;
+        case frame_graph_resource_buffer: {
+            batch->buffer_barriers[batch->num_buffer_barriers++] = (VkBufferMemoryBarrier2) {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2,
+                .srcStageMask = src_stage_flags,
+                .srcAccessMask = src_access_flags,
+                .dstStageMask = dst_usage->stage_flags,
+                .dstAccessMask = dst_usage->access_flags,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer = resource->buffer,
+                .offset = 0,
+                .size = VK_WHOLE_SIZE
+            };
+        } break;
+        case frame_graph_resource_image: {
+            batch->image_barriers[batch->num_image_barriers++] = (VkImageMemoryBarrier2) {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .srcStageMask = src_stage_flags,
+                .srcAccessMask = src_access_flags,
+                .dstStageMask = dst_usage->stage_flags,
+                .dstAccessMask = dst_usage->access_flags,
+                .oldLayout = old_layout,
+                .newLayout = dst_usage->layout,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = resource->image,
+                .subresourceRange = {
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .baseMipLevel = 0,
+                    .levelCount = 1,
+                    .baseArrayLayer = 0,
+                    .layerCount = resource->num_layers
+                }
+            };
+        } break;
+    }
+}
+
+// Only what the access actually needs, reads that are already visible get nothing and writes after reads only get an execution dependency on them
+static void add_access_barrier(barrier_batch_t* batch, frame_graph_resource_t* resource, const frame_graph_access_t* access) {
+    const frame_graph_usage_t* usage = &access->usage;
+    bool writes = is_writing_access(resource, access, resource->layout);
+
+    VkImageLayout old_layout = access->discard ? VK_IMAGE_LAYOUT_UNDEFINED : resource->layout;
+    if (writes) {
+        VkPipelineStageFlags2 src_stage_flags = resource->write_usage.stage_flags | resource->read_stage_flags;
+        bool layout_change = resource->type == frame_graph_resource_image && (access->discard || usage->layout != resource->layout);
+        if (src_stage_flags != VK_PIPELINE_STAGE_2_NONE || layout_change) {
+            add_barrier(batch, resource, src_stage_flags, access->discard ? VK_ACCESS_2_NONE : resource->write_usage.access_flags, usage, old_layout);
+        }
+    } else {
+        bool visible = (usage->stage_flags & ~resource->read_stage_flags) == 0 && (usage->access_flags & ~resource->read_access_flags) == 0;
+        if (!visible && resource->write_usage.stage_flags != VK_PIPELINE_STAGE_2_NONE) {
+            add_barrier(batch, resource, resource->write_usage.stage_flags, resource->write_usage.access_flags, usage, old_layout);
+        }
+    }
+
+    resource->layout = usage->layout;
+
+    if (is_write_access(usage->access_flags)) {
+        // Only writes have to be made available, reads in the same access are left out of later source masks
+        resource->write_usage = (frame_graph_usage_t) { usage->stage_flags, usage->access_flags & WRITE_ACCESS_FLAGS, usage->layout };
+        resource->read_stage_flags = VK_PIPELINE_STAGE_2_NONE;
+        resource->read_access_flags = VK_ACCESS_2_NONE;
+    } else if (writes) {
+        // Later reads only have to wait for the layout transition, which happened before this access
+        resource->write_usage = (frame_graph_usage_t) { usage->stage_flags, VK_ACCESS_2_NONE, usage->layout };
+        resource->read_stage_flags = usage->stage_flags;
+        resource->read_access_flags = usage->access_flags;
+    } else {
+        resource->read_stage_flags |= usage->stage_flags;
+        resource->read_access_flags |= usage->access_flags;
+    }
+}
+
+static void record_barrier_batch(VkCommandBuffer command_buffer, const barrier_batch_t* batch) {
+    if (batch->num_memory_barriers == 0 && batch->num_buffer_barriers == 0 && batch->num_image_barriers == 0) {
+        return;
+    }
+
+    vkCmdPipelineBarrier2(command_buffer, &(VkDependencyInfo) {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = batch->num_memory_barriers,
+        .pMemoryBarriers = batch->memory_barriers,
+        .bufferMemoryBarrierCount = batch->num_buffer_barriers,
+        .pBufferMemoryBarriers = batch->buffer_barriers,
+        .imageMemoryBarrierCount = batch->num_image_barriers,
+        .pImageMemoryBarriers = batch->image_barriers
+    });
+}
+
+// One barrier per level, then every pass of the level
+void record_frame_graph(frame_graph_t* graph, VkCommandBuffer command_buffer) {
+    uint32_t levels[FRAME_GRAPH_MAX_PASSES];
+    uint32_t num_levels = get_frame_graph_pass_levels(graph, levels);
+
+    for (uint32_t level = 0; level < num_levels; level++) {
+        barrier_batch_t batch = { 0 };
+        for (size_t i = 0; i < graph->num_passes; i++) {
+            if (levels[i] != level) {
+                continue;
+            }
+            const frame_graph_pass_t* pass = &graph->passes[i];
+            for (size_t j = 0; j < pass->num_accesses; j++) {
+                add_access_barrier(&batch, &graph->resources[pass->accesses[j].resource_index], &pass->accesses[j]);
+            }
+        }
+        record_barrier_batch(command_buffer, &batch);
+
+        for (size_t i = 0; i < graph->num_passes; i++) {
+            if (levels[i] == level && graph->passes[i].record != NULL) {
+                graph->passes[i].record(command_buffer, graph->passes[i].data);
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// Enough for the graphs recorded so far, they are built on the stack every time a command buffer is recorded
+#define FRAME_GRAPH_MAX_RESOURCES 8
+#define FRAME_GRAPH_MAX_PASSES 8
+#define FRAME_GRAPH_MAX_PASS_ACCESSES 4
+
+// What a pass does with a resource, or what was last done with it before the graph
+typedef struct {
+    VkPipelineStageFlags2 stage_flags;
+    VkAccessFlags2 access_flags;
+    // Ignored for anything but images
+    VkImageLayout layout;
+} frame_graph_usage_t;
+
+typedef enum {
+    // Global memory, for passes whose accesses are spread over more resources than are worth listing
+    frame_graph_resource_memory,
+    frame_graph_resource_buffer,
+    frame_graph_resource_image
+} frame_graph_resource_type_t;
+
+typedef struct {
+    frame_graph_resource_type_t type;
+    union {
+        VkBuffer buffer;
+        VkImage image;
+    };
+    uint32_t num_layers;
+    frame_graph_usage_t initial_usage;
+
+    // Tracked while recording, the last write and every read since that has been made visible
+    frame_graph_usage_t write_usage;
+    VkPipelineStageFlags2 read_stage_flags;
+    VkAccessFlags2 read_access_flags;
+    VkImageLayout layout;
+} frame_graph_resource_t;
+
+typedef void (*frame_graph_record_t)(VkCommandBuffer command_buffer, const void* data);
+
+typedef struct {
+    uint32_t resource_index;
+    frame_graph_usage_t usage;
+    // The contents before the pass do not matter, images are transitioned from the undefined layout
+    bool discard;
+} frame_graph_access_t;
+
+typedef struct {
+    // NULL for a pass that only hands its resources over to whatever comes after the graph
+    frame_graph_record_t record;
+    const void* data;
+    uint32_t num_accesses;
+    frame_graph_access_t accesses[FRAME_GRAPH_MAX_PASS_ACCESSES];
+} frame_graph_pass_t;
+
+// Passes are declared in an order that works, recording moves each one up to right after the passes it depends on so that independent passes share a barrier and overlap
+// Resources shared between queues are concurrent, the graph does no ownership transfers
+typedef struct {
+    uint32_t num_resources;
+    frame_graph_resource_t resources[FRAME_GRAPH_MAX_RESOURCES];
+    uint32_t num_passes;
+    frame_graph_pass_t passes[FRAME_GRAPH_MAX_PASSES];
+} frame_graph_t;
+
+void init_frame_graph(frame_graph_t* graph);
+// The graph is on the stack, more resources or passes than the maximums are a bug in the caller
+uint32_t add_frame_graph_memory(frame_graph_t* graph, const frame_graph_usage_t* initial_usage);
+uint32_t add_frame_graph_buffer(frame_graph_t* graph, VkBuffer buffer, const frame_graph_usage_t* initial_usage);
+uint32_t add_frame_graph_image(frame_graph_t* graph, VkImage image, uint32_t num_layers, const frame_graph_usage_t* initial_usage);
+void add_frame_graph_pass(frame_graph_t* graph, frame_graph_record_t record, const void* data, uint32_t num_accesses, const frame_graph_access_t accesses[]);
+void record_frame_graph(frame_graph_t* graph, VkCommandBuffer command_buffer);
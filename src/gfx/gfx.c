@@ -2,15 +2,19 @@
 #include "camera.h"
 #include "chrono.h"
 #include "gfx/default.h"
+#include "gfx/frame_graph.h"
 #include "gfx/gfx_util.h"
+#include "gfx/mandelbrot_batch.h"
 #include "gfx/mandelbrot_compute_pipeline.h"
 #include "gfx/mandelbrot_management.h"
 #include "gfx/mandelbrot_render_pipeline.h"
+#include "pacing.h"
 #include "result.h"
 #include "util.h"
 #include <GLFW/glfw3.h>
 #include <cglm/struct/mat3.h>
 #include <cglm/types-struct.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,17 +25,45 @@
 #define WINDOW_WIDTH 640
 #define WINDOW_HEIGHT 480
 
+// Swapchains replaced while their images may still be rendered to or presented, a resize every frame keeps about NUM_FRAMES_IN_FLIGHT of them around
+#define MAX_RETIRED_SWAPCHAINS 4
+
 typedef union {
-    uint32_t data[2];
+    uint32_t data[3];
     struct {
         uint32_t graphics;
         uint32_t presentation;
+        uint32_t compute;
     };
 } queue_family_indices_t;
 
+typedef struct {
+    VkCommandBuffer command_buffer;
+    bool recorded;
+    // Of the mandelbrot render pipeline when recorded, see get_mandelbrot_render_pipeline_version
+    uint32_t version;
+    // Of the front frame when recorded for the direct path, which are baked into the blit
+    VkOffset3D blit_offsets[2];
+} frame_command_buffer_t;
+
+typedef struct {
+    bool pending;
+    VkSwapchainKHR swapchain;
+    uint32_t num_images;
+    VkImageView* image_views;
+    // Frame command buffers that were replaced by a larger set along with the swapchain, or NULL
+    VkCommandBuffer* command_buffers;
+    uint32_t num_command_buffers;
+    // Destroyed once the render timeline reaches this, by then the frames that used it are rendered and presented
+    uint64_t render_value;
+} retired_swapchain_t;
+
 GLFWwindow* window;
 VkDevice device;
 static VkQueue graphics_queue;
+static VkQueue compute_queue;
+// Index of the compute queue within its family, nonzero when it is a second queue of the graphics family
+static uint32_t compute_queue_index;
 static VkPhysicalDevice physical_device;
 static VkPhysicalDeviceProperties physical_device_properties;
 VmaAllocator allocator;
@@ -40,29 +72,39 @@ VkSurfaceFormatKHR surface_format;
 static VkPresentModeKHR present_mode;
 static VkSemaphore image_available_semaphores[NUM_FRAMES_IN_FLIGHT];
 static VkSemaphore render_finished_semaphores[NUM_FRAMES_IN_FLIGHT];
-VkFence in_flight_fences[NUM_FRAMES_IN_FLIGHT];
+static VkFence in_flight_fences[NUM_FRAMES_IN_FLIGHT];
+
+// Signaled with an increasing value by every rendered frame so other work can wait on the frames that read its resources
+VkSemaphore render_timeline_semaphore;
+static uint64_t render_timeline_value = 0;
 static uint32_t num_swapchain_images;
 static VkImage* swapchain_images;
 static VkImageView* swapchain_image_views;
-static VkFramebuffer* swapchain_framebuffers;
 static VkSwapchainKHR swapchain;
 static VkInstance instance;
 static VkSurfaceKHR surface;
 static VkExtent2D swap_image_extent;
 static VkQueue presentation_queue;
-static bool framebuffer_resized;
+// Set by the input thread
+static atomic_bool framebuffer_resized;
+// Set when the swapchain could not be recreated, either because the window is minimized or too many swapchains are still retiring
+static bool swapchain_out_of_date;
+static retired_swapchain_t retired_swapchains[MAX_RETIRED_SWAPCHAINS];
 static VkCommandPool command_pool;
 
-VkSampleCountFlagBits render_multisample_flags;
+// Whether a finished frame can be blitted straight into the swapchain, see init_swapchain
+static bool direct_present_supported;
 
-VkRenderPass frame_render_pass;
-static VkCommandBuffer frame_command_buffers[NUM_FRAMES_IN_FLIGHT];
+// Recorded once for every combination of frame in flight, swapchain image and displayed mandelbrot frames, then reused until the swapchain or those frames change
+static frame_command_buffer_t* frame_command_buffers;
+// The most swapchain images the frame command buffers have room for, which stays the stride between swapchain images so that a frame in flight never re-records another's command buffers
+static uint32_t frame_command_buffer_image_capacity;
 
 static size_t frame_index = 0;
 
-static VkImage frame_image;
-static VmaAllocation frame_image_allocation;
-static VkImageView frame_image_view;
+// Per frame in flight, when the oldest input it shows arrived (0 if it shows none) and when it was handed to presentation
+static microseconds_t frame_input_times[NUM_FRAMES_IN_FLIGHT];
+static microseconds_t frame_present_times[NUM_FRAMES_IN_FLIGHT];
 
 static VkCommandBuffer generic_command_buffer;
 static VkFence generic_command_fence;
@@ -137,6 +179,16 @@ static uint32_t get_graphics_queue_family_index(uint32_t num_queue_families, con
     return NULL_UINT32;
 }
 
+// A family without graphics support usually maps to dedicated async compute hardware
+static uint32_t get_compute_queue_family_index(uint32_t num_queue_families, const VkQueueFamilyProperties queue_families[]) {
+    for (uint32_t i = 0; i < num_queue_families; i++) {
+        if ((queue_families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) && queue_families[i].timestampValidBits != 0) {
+            return i;
+        }
+    }
+    return NULL_UINT32;
+}
+
 static uint32_t get_presentation_queue_family_index(VkPhysicalDevice physical_device, uint32_t num_queue_families, const VkQueueFamilyProperties queue_families[]) {
     for (uint32_t i = 0; i < num_queue_families; i++) {
         if (!(queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
@@ -152,7 +204,7 @@ static uint32_t get_presentation_queue_family_index(VkPhysicalDevice physical_de
     return NULL_UINT32;
 }
 
-static result_t get_physical_device(uint32_t num_physical_devices, const VkPhysicalDevice physical_devices[], VkPhysicalDevice* out_physical_device, uint32_t* out_num_surface_formats, uint32_t* out_num_present_modes, queue_family_indices_t* out_queue_family_indices) {
+static result_t get_physical_device(uint32_t num_physical_devices, const VkPhysicalDevice physical_devices[], VkPhysicalDevice* out_physical_device, uint32_t* out_num_surface_formats, uint32_t* out_num_present_modes, queue_family_indices_t* out_queue_family_indices, uint32_t* out_compute_queue_index) {
     result_t result = result_suitable_physical_device_unavailable;
 
     printf("Physical devices: %d\n", num_physical_devices);
@@ -177,10 +229,20 @@ static result_t get_physical_device(uint32_t num_physical_devices, const VkPhysi
             continue;
         }
 
-        VkPhysicalDeviceFeatures features;
-        vkGetPhysicalDeviceFeatures(physical_device, &features);
+        VkPhysicalDeviceVulkan13Features vulkan_13_features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES
+        };
+        VkPhysicalDeviceVulkan12Features vulkan_12_features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+            .pNext = &vulkan_13_features
+        };
+        VkPhysicalDeviceFeatures2 features = {
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &vulkan_12_features
+        };
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
 
-        if (!features.samplerAnisotropy) {
+        if (!features.features.samplerAnisotropy || !vulkan_12_features.timelineSemaphore || !vulkan_13_features.synchronization2 || !vulkan_13_features.dynamicRendering) {
             continue;
         }
 
@@ -223,10 +285,21 @@ static result_t get_physical_device(uint32_t num_physical_devices, const VkPhysi
             break;
         }
 
+        // Without a compute only family fall back to a second queue of the graphics family, and failing that share the graphics queue
+        uint32_t compute_queue_family_index = get_compute_queue_family_index(num_queue_families, queue_families);
+        uint32_t compute_queue_index = 0;
+        if (compute_queue_family_index == NULL_UINT32) {
+            compute_queue_family_index = graphics_queue_family_index;
+            if (queue_families[graphics_queue_family_index].queueCount > 1) {
+                compute_queue_index = 1;
+            }
+        }
+
         *out_physical_device = physical_device;
         *out_num_surface_formats = num_surface_formats;
         *out_num_present_modes = num_present_modes;
-        *out_queue_family_indices = (queue_family_indices_t) {{ graphics_queue_family_index, presentation_queue_family_index }};
+        *out_queue_family_indices = (queue_family_indices_t) {{ graphics_queue_family_index, presentation_queue_family_index, compute_queue_family_index }};
+        *out_compute_queue_index = compute_queue_index;
         return result_success;
     }
     return result;
@@ -243,14 +316,35 @@ static VkSurfaceFormatKHR get_surface_format(uint32_t num_surface_formats, const
     return surface_formats[0];
 }
 
+// How far behind the newest frame presentation can be. FIFO queues up to a frame per frame in flight and mailbox shows the newest at the next refresh
+static microseconds_t get_present_mode_latency(VkPresentModeKHR present_mode) {
+    switch (present_mode) {
+        case VK_PRESENT_MODE_MAILBOX_KHR: return get_refresh_interval();
+        default: return NUM_FRAMES_IN_FLIGHT * get_refresh_interval();
+    }
+}
+
+// The steadiest mode that meets PACING_TARGET_LATENCY, or FIFO if none does. Immediate is never picked since it tears
 static VkPresentModeKHR get_present_mode(uint32_t num_present_modes, const VkPresentModeKHR present_modes[]) {
-    for (size_t i = 0; i < num_present_modes; i++) {
-        VkPresentModeKHR present_mode = present_modes[i];
-        if (present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-            return present_mode;
+    static const VkPresentModeKHR preferred_present_modes[] = { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+
+    for (size_t i = 0; i < NUM_ELEMS(preferred_present_modes); i++) {
+        VkPresentModeKHR preferred_present_mode = preferred_present_modes[i];
+
+        bool supported = false;
+        for (size_t j = 0; j < num_present_modes; j++) {
+            if (present_modes[j] == preferred_present_mode) {
+                supported = true;
+                break;
+            }
+        }
+
+        if (supported && get_present_mode_latency(preferred_present_mode) <= PACING_TARGET_LATENCY) {
+            return preferred_present_mode;
         }
     }
 
+    // Always supported
     return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -261,7 +355,7 @@ static VkExtent2D get_swap_image_extent(const VkSurfaceCapabilitiesKHR* capabili
 
     int width;
     int height;
-    glfwGetFramebufferSize(window, &width, &height);
+    get_camera_framebuffer_size(&width, &height);
     VkExtent2D extent = { (uint32_t)width, (uint32_t)height };
 
     extent.width = clamp_uint32(extent.width, capabilities->minImageExtent.width, capabilities->maxImageExtent.width);
@@ -275,6 +369,13 @@ static result_t init_swapchain(void) {
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &capabilities);
     swap_image_extent = get_swap_image_extent(&capabilities); // NOTE: Not actually a problem? (https://github.com/KhronosGroup/Vulkan-ValidationLayers/issues/1340)
 
+    // Blits filter from the mandelbrot color format into the surface format
+    VkFormatProperties color_format_properties;
+    VkFormatProperties surface_format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, MANDELBROT_COLOR_FORMAT, &color_format_properties);
+    vkGetPhysicalDeviceFormatProperties(physical_device, surface_format.format, &surface_format_properties);
+    direct_present_supported = (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) && (color_format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) && (color_format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) && (surface_format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+
     uint32_t min_num_swapchain_images = capabilities.minImageCount + 1;
     if (capabilities.maxImageCount > 0) {
         min_num_swapchain_images = clamp_uint32(min_num_swapchain_images, 0, capabilities.maxImageCount);
@@ -288,12 +389,13 @@ static result_t init_swapchain(void) {
         .imageColorSpace = surface_format.colorSpace,
         .imageExtent = swap_image_extent,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (direct_present_supported ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0),
         .preTransform = capabilities.currentTransform,
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
         .presentMode = present_mode,
         .clipped = VK_TRUE,
-        .oldSwapchain = VK_NULL_HANDLE
+        // Lets the presentation engine hand its resources over rather than tearing them down first, the old swapchain is retired by the caller
+        .oldSwapchain = swapchain
     };
 
     if (queue_family_indices.graphics != queue_family_indices.presentation) {
@@ -313,7 +415,7 @@ static result_t init_swapchain(void) {
     return result_success;
 }
 
-static result_t init_swapchain_framebuffers(void) {
+static result_t init_swapchain_image_views(void) {
     vkGetSwapchainImagesKHR(device, swapchain, &num_swapchain_images, swapchain_images);
 
     for (size_t i = 0; i < num_swapchain_images; i++) {
@@ -326,96 +428,163 @@ static result_t init_swapchain_framebuffers(void) {
             return result_image_view_create_failure;
         }
     }
+    return result_success;
+}
 
+static void term_swapchain(void) {
     for (size_t i = 0; i < num_swapchain_images; i++) {
-        if (vkCreateFramebuffer(device, &(VkFramebufferCreateInfo) {
-            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-            .renderPass = frame_render_pass,
-            .attachmentCount = 2,
-            .pAttachments = (VkImageView[2]) { frame_image_view, swapchain_image_views[i] },
-            .width = swap_image_extent.width,
-            .height = swap_image_extent.height,
-            .layers = 1
-        }, NULL, &swapchain_framebuffers[i]) != VK_SUCCESS) {
-            return result_framebuffer_create_failure;
-        }
+        vkDestroyImageView(device, swapchain_image_views[i], NULL);
     }
-    return result_success;
+    
+    vkDestroySwapchainKHR(device, swapchain, NULL);
 }
 
-result_t init_swapchain_dependents(void) {
-    if (vmaCreateImage(allocator, &(VkImageCreateInfo) {
-        DEFAULT_VK_IMAGE,
-        .extent.width = swap_image_extent.width,
-        .extent.height = swap_image_extent.height,
-        .format = surface_format.format,
-        .samples = render_multisample_flags,
-        .usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
-    }, &device_allocation_create_info, &frame_image, &frame_image_allocation, NULL) != VK_SUCCESS) {
-        return result_image_create_failure;
+static uint32_t get_num_frame_command_buffers(void) {
+    return NUM_FRAMES_IN_FLIGHT * frame_command_buffer_image_capacity * NUM_MANDELBROT_FRAMES_IN_FLIGHT * (NUM_MANDELBROT_FRAMES_IN_FLIGHT + 2);
+}
+
+static result_t init_frame_command_buffers(void) {
+    uint32_t num_frame_command_buffers = get_num_frame_command_buffers();
+    VkCommandBuffer command_buffers[num_frame_command_buffers];
+    if (vkAllocateCommandBuffers(device, &(VkCommandBufferAllocateInfo) {
+        DEFAULT_VK_COMMAND_BUFFER,
+        .commandPool = command_pool,
+        .commandBufferCount = num_frame_command_buffers
+    }, command_buffers) != VK_SUCCESS) {
+        return result_command_buffers_allocate_failure;
     }
 
-    if (vkCreateImageView(device, &(VkImageViewCreateInfo) {
-        DEFAULT_VK_IMAGE_VIEW,
-        .image = frame_image,
-        .format = surface_format.format,
-        .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT
-    }, NULL, &frame_image_view) != VK_SUCCESS) {
-        return result_image_view_create_failure;
+    frame_command_buffers = malloc(num_frame_command_buffers*sizeof(frame_command_buffer_t));
+    for (size_t i = 0; i < num_frame_command_buffers; i++) {
+        frame_command_buffers[i] = (frame_command_buffer_t) { command_buffers[i], false, 0, {} };
     }
 
     return result_success;
 }
 
-void term_swapchain_dependents(void) {
-    vkDestroyImageView(device, frame_image_view, NULL);
-    vmaDestroyImage(allocator, frame_image, frame_image_allocation);
+static void destroy_retired_swapchain(retired_swapchain_t* retired_swapchain) {
+    for (size_t i = 0; i < retired_swapchain->num_images; i++) {
+        vkDestroyImageView(device, retired_swapchain->image_views[i], NULL);
+    }
+    free(retired_swapchain->image_views);
+    vkDestroySwapchainKHR(device, retired_swapchain->swapchain, NULL);
+
+    if (retired_swapchain->command_buffers != NULL) {
+        vkFreeCommandBuffers(device, command_pool, retired_swapchain->num_command_buffers, retired_swapchain->command_buffers);
+        free(retired_swapchain->command_buffers);
+    }
+    retired_swapchain->pending = false;
 }
 
-static void term_swapchain(void) {
-    for (size_t i = 0; i < num_swapchain_images; i++) {
-        vkDestroyImageView(device, swapchain_image_views[i], NULL);
-        vkDestroyFramebuffer(device, swapchain_framebuffers[i], NULL);
+static void destroy_completed_retired_swapchains(void) {
+    uint64_t completed_render_value;
+    vkGetSemaphoreCounterValue(device, render_timeline_semaphore, &completed_render_value);
+
+    for (size_t i = 0; i < MAX_RETIRED_SWAPCHAINS; i++) {
+        retired_swapchain_t* retired_swapchain = &retired_swapchains[i];
+        if (retired_swapchain->pending && completed_render_value >= retired_swapchain->render_value) {
+            destroy_retired_swapchain(retired_swapchain);
+        }
     }
-    
-    vkDestroySwapchainKHR(device, swapchain, NULL);
 }
 
-void reinit_swapchain(void) {
-    // Even the tutorials use bad hacks, im all in
+static retired_swapchain_t* get_free_retired_swapchain(void) {
+    for (size_t i = 0; i < MAX_RETIRED_SWAPCHAINS; i++) {
+        if (!retired_swapchains[i].pending) {
+            return &retired_swapchains[i];
+        }
+    }
+    return NULL;
+}
+
+// Nothing is waited on unless too many are retired, the new swapchain is created from the old one and the old one is destroyed once the frames still using it are done
+static result_t reinit_swapchain(bool out_of_date) {
+    result_t result;
+
+    // A minimized window has nothing to present to, draw_gfx waits for the camera instead until it is restored
     int width;
     int height;
-    glfwGetFramebufferSize(window, &width, &height);
+    get_camera_framebuffer_size(&width, &height);
+    if (width == 0 || height == 0) {
+        swapchain_out_of_date = true;
+        return result_success;
+    }
 
-    while (width == 0 || height == 0) {
-        glfwGetFramebufferSize(window, &width, &height);
-        glfwWaitEvents();
+    destroy_completed_retired_swapchains();
+    retired_swapchain_t* retired_swapchain = get_free_retired_swapchain();
+    if (retired_swapchain == NULL) {
+        // A suboptimal swapchain can still be presented to, it is replaced on a later frame instead
+        if (!out_of_date) {
+            swapchain_out_of_date = true;
+            return result_success;
+        }
+        // Only hit when the swapchain is invalidated faster than frames finish, the oldest one is waited for
+        // No frames are submitted until there is a swapchain again, so nothing past the last submitted one is waited on
+        retired_swapchain = &retired_swapchains[0];
+        for (size_t i = 1; i < MAX_RETIRED_SWAPCHAINS; i++) {
+            if (retired_swapchains[i].render_value < retired_swapchain->render_value) {
+                retired_swapchain = &retired_swapchains[i];
+            }
+        }
+        uint64_t wait_value = retired_swapchain->render_value < render_timeline_value ? retired_swapchain->render_value : render_timeline_value;
+        vkWaitSemaphores(device, &(VkSemaphoreWaitInfo) {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &render_timeline_semaphore,
+            .pValues = &wait_value
+        }, UINT64_MAX);
+        destroy_retired_swapchain(retired_swapchain);
     }
-    //
-    
-    term_swapchain_dependents();
-    term_swapchain();
-    init_swapchain();
-    init_swapchain_dependents();
-    init_swapchain_framebuffers();
-}
 
-static void framebuffer_resize(GLFWwindow*, int, int) {
-    framebuffer_resized = true;
-}
+    *retired_swapchain = (retired_swapchain_t) {
+        .pending = true,
+        .swapchain = swapchain,
+        .num_images = num_swapchain_images,
+        .image_views = swapchain_image_views,
+        .command_buffers = NULL,
+        .num_command_buffers = 0,
+        // Frames in flight that were already submitted may still present its images
+        .render_value = render_timeline_value + NUM_FRAMES_IN_FLIGHT
+    };
 
-static VkSampleCountFlagBits get_max_multisample_flags(const VkPhysicalDeviceProperties* properties) {
-    VkSampleCountFlags flags = properties->limits.framebufferColorSampleCounts;
+    if ((result = init_swapchain()) != result_success) {
+        return result;
+    }
+    swapchain_out_of_date = false;
 
-    // Way too overkill for this project
-    // if (flags & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
-    // if (flags & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
-    // if (flags & VK_SAMPLE_COUNT_16_BIT) { return VK_SAMPLE_COUNT_16_BIT; }
-    if (flags & VK_SAMPLE_COUNT_8_BIT) { return VK_SAMPLE_COUNT_8_BIT; }
-    if (flags & VK_SAMPLE_COUNT_4_BIT) { return VK_SAMPLE_COUNT_4_BIT; }
-    if (flags & VK_SAMPLE_COUNT_2_BIT) { return VK_SAMPLE_COUNT_2_BIT; }
+    vkGetSwapchainImagesKHR(device, swapchain, &num_swapchain_images, NULL);
+    swapchain_images = realloc(swapchain_images, num_swapchain_images*sizeof(VkImage));
+    swapchain_image_views = malloc(num_swapchain_images*sizeof(VkImageView));
+    if ((result = init_swapchain_image_views()) != result_success) {
+        return result;
+    }
+
+    // Command buffers of frames still in flight may be pending, a larger set is allocated next to them and the old set retires with the swapchain
+    if (num_swapchain_images > frame_command_buffer_image_capacity) {
+        uint32_t num_command_buffers = get_num_frame_command_buffers();
+        retired_swapchain->command_buffers = malloc(num_command_buffers*sizeof(VkCommandBuffer));
+        retired_swapchain->num_command_buffers = num_command_buffers;
+        for (size_t i = 0; i < num_command_buffers; i++) {
+            retired_swapchain->command_buffers[i] = frame_command_buffers[i].command_buffer;
+        }
+        free(frame_command_buffers);
+
+        frame_command_buffer_image_capacity = num_swapchain_images;
+        if ((result = init_frame_command_buffers()) != result_success) {
+            return result;
+        }
+    } else {
+        // Every frame in flight re-records its own command buffers only after waiting on its fence
+        for (size_t i = 0; i < get_num_frame_command_buffers(); i++) {
+            frame_command_buffers[i].recorded = false;
+        }
+    }
 
-    return VK_SAMPLE_COUNT_1_BIT;
+    return result_success;
+}
+
+static void framebuffer_resize(GLFWwindow*, int, int) {
+    framebuffer_resized = true;
 }
 
 static result_t init_vk_core(void) {
@@ -463,7 +632,7 @@ static result_t init_vk_core(void) {
         VkPhysicalDevice physical_devices[num_physical_devices];
         vkEnumeratePhysicalDevices(instance, &num_physical_devices, physical_devices);
 
-        if ((result = get_physical_device(num_physical_devices, physical_devices, &physical_device, &num_surface_formats, &num_present_modes, &queue_family_indices)) != result_success) {
+        if ((result = get_physical_device(num_physical_devices, physical_devices, &physical_device, &num_surface_formats, &num_present_modes, &queue_family_indices, &compute_queue_index)) != result_success) {
             return result;
         }
     }
@@ -471,25 +640,53 @@ static result_t init_vk_core(void) {
     vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
     printf("Loaded physical device \"%s\"\n", physical_device_properties.deviceName);
 
-    render_multisample_flags = get_max_multisample_flags(&physical_device_properties);
+    // Rendering gets the higher priority so that long dispatches do not hold up presentation
+    const float queue_priorities[2] = { 1.0f, 0.5f };
+
+    uint32_t num_queue_create_infos = 0;
+    VkDeviceQueueCreateInfo queue_create_infos[3];
+    queue_create_infos[num_queue_create_infos++] = (VkDeviceQueueCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = queue_family_indices.graphics,
+        .queueCount = compute_queue_index + 1,
+        .pQueuePriorities = queue_priorities
+    };
+    if (queue_family_indices.compute != queue_family_indices.graphics) {
+        queue_create_infos[num_queue_create_infos++] = (VkDeviceQueueCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = queue_family_indices.compute,
+            .queueCount = 1,
+            .pQueuePriorities = &queue_priorities[1]
+        };
+    }
+    if (queue_family_indices.presentation != queue_family_indices.graphics) {
+        queue_create_infos[num_queue_create_infos++] = (VkDeviceQueueCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = queue_family_indices.presentation,
+            .queueCount = 1,
+            .pQueuePriorities = queue_priorities
+        };
+    }
 
     if (vkCreateDevice(physical_device, &(VkDeviceCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
         .pNext = &(VkPhysicalDeviceFeatures2) {
             .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+            .pNext = &(VkPhysicalDeviceVulkan12Features) {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+                .pNext = &(VkPhysicalDeviceVulkan13Features) {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+                    .synchronization2 = VK_TRUE,
+                    .dynamicRendering = VK_TRUE
+                },
+                .timelineSemaphore = VK_TRUE
+            },
             .features = {
                 .samplerAnisotropy = VK_TRUE
             }
         },
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = (VkDeviceQueueCreateInfo[1]) {
-            {
-                .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-                .queueFamilyIndex = queue_family_indices.graphics,
-                .queueCount = 1,
-                .pQueuePriorities = (float[1]) { 1.0f }
-            }
-        },
+        .queueCreateInfoCount = num_queue_create_infos,
+        .pQueueCreateInfos = queue_create_infos,
         .pEnabledFeatures = NULL,
 
         .enabledExtensionCount = NUM_ELEMS(extensions),
@@ -514,6 +711,7 @@ static result_t init_vk_core(void) {
 
     vkGetDeviceQueue(device, queue_family_indices.graphics, 0, &graphics_queue);
     vkGetDeviceQueue(device, queue_family_indices.presentation, 0, &presentation_queue);
+    vkGetDeviceQueue(device, queue_family_indices.compute, compute_queue_index, &compute_queue);
 
     {
         VkSurfaceFormatKHR surface_formats[num_surface_formats];
@@ -532,10 +730,6 @@ static result_t init_vk_core(void) {
     if ((result = init_swapchain()) != result_success) {
         return result;
     }
-    
-    if ((result = init_swapchain_dependents()) != result_success) {
-        return result;
-    }
 
     for (size_t i = 0; i < NUM_FRAMES_IN_FLIGHT; i++) {
         if (
@@ -550,6 +744,10 @@ static result_t init_vk_core(void) {
         }
     }
 
+    if ((result = create_timeline_semaphore(&render_timeline_semaphore)) != result_success) {
+        return result;
+    }
+
     if (vkCreateCommandPool(device, &(VkCommandPoolCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
@@ -558,70 +756,16 @@ static result_t init_vk_core(void) {
         return result_command_pool_create_failure;
     }
 
-    if (vkAllocateCommandBuffers(device, &(VkCommandBufferAllocateInfo) {
-        DEFAULT_VK_COMMAND_BUFFER,
-        .commandPool = command_pool,
-        .commandBufferCount = NUM_FRAMES_IN_FLIGHT
-    }, frame_command_buffers) != VK_SUCCESS) {
-        return result_command_buffers_allocate_failure;
-    }
-
-    if (vkCreateRenderPass(device, &(VkRenderPassCreateInfo) {
-        DEFAULT_VK_RENDER_PASS,
-
-        .attachmentCount = 2,
-        .pAttachments = (VkAttachmentDescription[2]) {
-            {
-                DEFAULT_VK_ATTACHMENT,
-                .format = surface_format.format,
-                .samples = render_multisample_flags,
-                .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-                .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-            },
-            {
-                DEFAULT_VK_ATTACHMENT,
-                .format = surface_format.format,
-                .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-                .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-                .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-            }
-        },
-
-        .pSubpasses = &(VkSubpassDescription) {
-            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-
-            .colorAttachmentCount = 1,
-            .pColorAttachments = &(VkAttachmentReference) {
-                .attachment = 0,
-                .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-            },
-
-            .pResolveAttachments = &(VkAttachmentReference) {
-                .attachment = 1,
-                .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-            }
-        },
-
-        .dependencyCount = 1,
-        .pDependencies = &(VkSubpassDependency) {
-            .srcSubpass = VK_SUBPASS_EXTERNAL,
-            .dstSubpass = 0,
-            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-            .srcAccessMask = 0,
-            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
-        }
-    }, NULL, &frame_render_pass) != VK_SUCCESS) {
-        return result_render_pass_create_failure;
-    }
-
     vkGetSwapchainImagesKHR(device, swapchain, &num_swapchain_images, NULL);
     swapchain_images = malloc(num_swapchain_images*sizeof(VkImage));
     swapchain_image_views = malloc(num_swapchain_images*sizeof(VkImageView));
-    swapchain_framebuffers = malloc(num_swapchain_images*sizeof(VkFramebuffer));
 
-    if ((result = init_swapchain_framebuffers()) != result_success) {
+    if ((result = init_swapchain_image_views()) != result_success) {
+        return result;
+    }
+
+    frame_command_buffer_image_capacity = num_swapchain_images;
+    if ((result = init_frame_command_buffers()) != result_success) {
         return result;
     }
 
@@ -640,18 +784,31 @@ static result_t init_vk_core(void) {
 
     if (vkCreateDescriptorPool(device, &(VkDescriptorPoolCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .poolSizeCount = 2,
-        .pPoolSizes = (VkDescriptorPoolSize[2]) {
+        .poolSizeCount = 5,
+        .pPoolSizes = (VkDescriptorPoolSize[5]) {
             {
                 .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-                .descriptorCount = 12
+                .descriptorCount = 24
+            },
+            {
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 32
             },
             {
                 .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                 .descriptorCount = 12
+            },
+            {
+                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .descriptorCount = 12
+            },
+            {
+                .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                .descriptorCount = 12
             }
         },
-        .maxSets = 1
+        // A compute and two render descriptor sets for every mandelbrot frame, and one for batches
+        .maxSets = (3 * NUM_MANDELBROT_FRAMES_IN_FLIGHT) + 1
     }, NULL, &generic_descriptor_pool) != VK_SUCCESS) {
         return result_descriptor_pool_create_failure;
     }
@@ -692,11 +849,15 @@ static result_t init_vk_core(void) {
         return result;
     }
 
-    if ((result = init_mandelbrot_management(graphics_queue, generic_command_buffer, generic_command_fence, queue_family_indices.graphics)) != result_success) {
+    if ((result = init_mandelbrot_management(physical_device, graphics_queue, generic_command_buffer, generic_command_fence, queue_family_indices.graphics, compute_queue, queue_family_indices.compute)) != result_success) {
         return result;
     }
 
-    if ((result = init_mandelbrot_render_pipeline(graphics_queue, generic_command_buffer, generic_command_fence, generic_descriptor_pool, &physical_device_properties)) != result_success) {
+    if ((result = init_mandelbrot_render_pipeline(generic_descriptor_pool, &physical_device_properties)) != result_success) {
+        return result;
+    }
+
+    if ((result = init_mandelbrot_batch(compute_queue, (uint32_t[2]) { queue_family_indices.graphics, queue_family_indices.compute }, generic_descriptor_pool)) != result_success) {
         return result;
     }
 
@@ -705,20 +866,23 @@ static result_t init_vk_core(void) {
 
 static void term_vk_core(void) {
     vkDeviceWaitIdle(device);
+    term_mandelbrot_batch();
     term_mandelbrot_render_pipeline();
     term_mandelbrot_management();
     term_mandelbrot_compute_pipeline();
 
     vkDestroyQueryPool(device, timestamp_query_pool, NULL);
     vkDestroyDescriptorPool(device, generic_descriptor_pool, NULL);
-    
-    vkDestroyRenderPass(device, frame_render_pass, NULL);
+
     vkDestroyCommandPool(device, command_pool, NULL);
 
     vkDestroyFence(device, generic_command_fence, NULL);
 
-    term_swapchain_dependents();
-    
+    for (size_t i = 0; i < MAX_RETIRED_SWAPCHAINS; i++) {
+        if (retired_swapchains[i].pending) {
+            destroy_retired_swapchain(&retired_swapchains[i]);
+        }
+    }
     term_swapchain();
 
     for (size_t i = 0; i < NUM_FRAMES_IN_FLIGHT; i++) {
@@ -727,6 +891,8 @@ static void term_vk_core(void) {
         vkDestroyFence(device, in_flight_fences[i], NULL);
     }
 
+    vkDestroySemaphore(device, render_timeline_semaphore, NULL);
+
     vmaDestroyAllocator(allocator);
 
     vkDestroyDevice(device, NULL);
@@ -735,7 +901,7 @@ static void term_vk_core(void) {
 
     free(swapchain_images);
     free(swapchain_image_views);
-    free(swapchain_framebuffers);
+    free(frame_command_buffers);
 }
 
 static result_t init_glfw_core(void) {
@@ -758,9 +924,152 @@ static void term_glfw_core(void) {
     glfwTerminate();
 }
 
-result_t draw_gfx(microseconds_t* out_frame_render_time, microseconds_t* out_mandelbrot_frame_compute_time) {
+// The part of a frame's image that covers the framebuffer, only meaningful for frames that is_mandelbrot_frame_presentable accepts since those are at full resolution
+static void get_mandelbrot_blit_offsets(size_t mandelbrot_frame_index, VkOffset3D offsets[2]) {
+    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[mandelbrot_frame_index];
+    offsets[0] = (VkOffset3D) { (int32_t) dispatch->margin, (int32_t) dispatch->margin, 0 };
+    offsets[1] = (VkOffset3D) { (int32_t) (dispatch->margin + dispatch->framebuffer_width), (int32_t) (dispatch->margin + dispatch->framebuffer_height), 1 };
+}
+
+typedef struct {
+    uint32_t image_index;
+    size_t mandelbrot_front_frame_index;
+    const VkOffset3D* blit_offsets;
+} direct_frame_t;
+
+// A finished full resolution frame that the view has not moved away from is blitted straight into the swapchain image
+static void record_direct_frame(VkCommandBuffer command_buffer, const void* data) {
+    const direct_frame_t* frame = data;
+
+    vkCmdBlitImage(command_buffer, mandelbrot_color_images[frame->mandelbrot_front_frame_index], VK_IMAGE_LAYOUT_GENERAL, swapchain_images[frame->image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &(VkImageBlit) {
+        DEFAULT_VK_IMAGE_BLIT,
+        .srcOffsets[0] = frame->blit_offsets[0],
+        .srcOffsets[1] = frame->blit_offsets[1],
+        .dstOffsets[1] = { (int32_t) swap_image_extent.width, (int32_t) swap_image_extent.height, 1 }
+    }, VK_FILTER_LINEAR);
+}
+
+typedef struct {
+    uint32_t image_index;
+    size_t mandelbrot_front_frame_index;
+    bool draw_mandelbrot_back_frame;
+    size_t mandelbrot_back_frame_index;
+} reprojected_frame_t;
+
+// Otherwise the frames are reprojected by a single sample fullscreen triangle each
+static void record_reprojected_frame(VkCommandBuffer command_buffer, const void* data) {
+    const reprojected_frame_t* frame = data;
+
+    VkViewport viewport = {
+        .x = 0.0f,
+        .y = 0.0f,
+        .width = (float)swap_image_extent.width,
+        .height = (float)swap_image_extent.height,
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor = {
+        .offset = { 0, 0 },
+        .extent = swap_image_extent
+    };
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    vkCmdBeginRendering(command_buffer, &(VkRenderingInfo) {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea.offset = { 0, 0 },
+        .renderArea.extent = swap_image_extent,
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &(VkRenderingAttachmentInfo) {
+            .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+            .imageView = swapchain_image_views[frame->image_index],
+            .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+            .clearValue = { .color = { .float32 = { 0.62f, 0.78f, 1.0f, 1.0f } } }
+        }
+    });
+
+    record_mandelbrot_render_pipeline(command_buffer, frame->mandelbrot_front_frame_index, frame_index, 0);
+    if (frame->draw_mandelbrot_back_frame) {
+        record_mandelbrot_render_pipeline(command_buffer, frame->mandelbrot_back_frame_index, frame_index, 1);
+    }
+
+    vkCmdEndRendering(command_buffer);
+}
+
+static result_t record_frame_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index, size_t mandelbrot_front_frame_index, bool draw_mandelbrot_back_frame, size_t mandelbrot_back_frame_index, bool direct, const VkOffset3D blit_offsets[2]) {
+    if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
+        return result_command_buffer_reset_failure;
+    }
+
+    if (vkBeginCommandBuffer(command_buffer, &(VkCommandBufferBeginInfo) {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+    }) != VK_SUCCESS) {
+        return result_command_buffer_begin_failure;
+    }
+
+    vkCmdResetQueryPool(command_buffer, timestamp_query_pool, 2 * (uint32_t) frame_index, 2);
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, 2 * (uint32_t) frame_index);
+
+    // Swapchain images are only ever written whole, whatever they held before is discarded
+    // The stage the acquire semaphore is waited on goes in as the initial usage, so that the transition waits for the presentation engine to let go of the image
+    frame_graph_t graph;
+    init_frame_graph(&graph);
+
+    direct_frame_t direct_frame = { image_index, mandelbrot_front_frame_index, blit_offsets };
+    reprojected_frame_t reprojected_frame = { image_index, mandelbrot_front_frame_index, draw_mandelbrot_back_frame, mandelbrot_back_frame_index };
+    if (direct) {
+        uint32_t swapchain_image = add_frame_graph_image(&graph, swapchain_images[image_index], 1, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED });
+        add_frame_graph_pass(&graph, record_direct_frame, &direct_frame, 1, (frame_graph_access_t[]) {
+            { swapchain_image, { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL }, true }
+        });
+        add_frame_graph_pass(&graph, NULL, NULL, 1, (frame_graph_access_t[]) {
+            { swapchain_image, { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR }, false }
+        });
+    } else {
+        uint32_t swapchain_image = add_frame_graph_image(&graph, swapchain_images[image_index], 1, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED });
+        add_frame_graph_pass(&graph, record_reprojected_frame, &reprojected_frame, 1, (frame_graph_access_t[]) {
+            { swapchain_image, { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL }, true }
+        });
+        add_frame_graph_pass(&graph, NULL, NULL, 1, (frame_graph_access_t[]) {
+            { swapchain_image, { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR }, false }
+        });
+    }
+    record_frame_graph(&graph, command_buffer);
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, 2 * (uint32_t) frame_index + 1);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        return result_command_buffer_end_failure;
+    }
+
+    return result_success;
+}
+
+result_t draw_gfx(microseconds_t* out_frame_render_time, microseconds_t* out_mandelbrot_frame_compute_time, microseconds_t* out_input_latency) {
     result_t result;
 
+    // Recreated before acquiring rather than after presenting so that no frame is lost to an out of date swapchain
+    if (atomic_exchange(&framebuffer_resized, false) || swapchain_out_of_date) {
+        if ((result = reinit_swapchain(false)) != result_success) {
+            return result;
+        }
+    }
+
+    // Blocks until the input thread sees the window change instead of spinning, nothing is computed or rendered while it is minimized
+    if (swapchain_out_of_date) {
+        int width;
+        int height;
+        get_camera_framebuffer_size(&width, &height);
+        if (width == 0 || height == 0) {
+            wait_camera();
+            return result_success;
+        }
+    }
+
     if ((result = manage_mandelbrot_frames(&physical_device_properties, out_mandelbrot_frame_compute_time)) != result_success) {
         return result;
     }
@@ -775,12 +1084,17 @@ result_t draw_gfx(microseconds_t* out_frame_render_time, microseconds_t* out_man
 
     *out_frame_render_time = get_query_microseconds(timestamps[0], timestamps[1], physical_device_properties.limits.timestampPeriod);
 
+    // Input to the end of rendering the frame that showed it, scanout is not included since presentation timing is not available. Left as is by frames that showed no input
+    if (frame_input_times[frame_index] != 0) {
+        *out_input_latency = (frame_present_times[frame_index] - frame_input_times[frame_index]) + *out_frame_render_time;
+        frame_input_times[frame_index] = 0;
+    }
+
     uint32_t image_index;
     {
         VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, image_available_semaphore, VK_NULL_HANDLE, &image_index);
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-            reinit_swapchain();
-            return result_success;
+            return reinit_swapchain(true);
         } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
             return result_swapchain_image_acquire_failure;
         }
@@ -788,75 +1102,76 @@ result_t draw_gfx(microseconds_t* out_frame_render_time, microseconds_t* out_man
 
     vkResetFences(device, 1, &in_flight_fence);
 
-    VkCommandBuffer command_buffer = frame_command_buffers[frame_index];
-
-    vkResetCommandBuffer(command_buffer, 0);
+    uint64_t render_value = render_timeline_value + 1;
 
-    if (vkBeginCommandBuffer(command_buffer, &(VkCommandBufferBeginInfo) {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
-    }) != VK_SUCCESS) {
-        return result_command_buffer_begin_failure;
+    size_t mandelbrot_front_frame_index = get_mandelbrot_front_frame_index();
+    mandelbrot_frame_render_values[mandelbrot_front_frame_index] = render_value;
+    uint64_t mandelbrot_compute_wait_value = mandelbrot_frame_compute_values[mandelbrot_front_frame_index];
+
+    // Tiles of the back frame that are already done get composited over the front frame
+    bool draw_mandelbrot_back_frame = is_mandelbrot_back_frame_in_progress();
+    size_t mandelbrot_back_frame_index = draw_mandelbrot_back_frame ? get_mandelbrot_back_frame_index() : mandelbrot_front_frame_index;
+    if (draw_mandelbrot_back_frame) {
+        mandelbrot_frame_render_values[mandelbrot_back_frame_index] = render_value;
+        if (mandelbrot_frame_compute_values[mandelbrot_back_frame_index] > mandelbrot_compute_wait_value) {
+            mandelbrot_compute_wait_value = mandelbrot_frame_compute_values[mandelbrot_back_frame_index];
+        }
     }
 
-    vkCmdResetQueryPool(command_buffer, timestamp_query_pool, 2 * (uint32_t) frame_index, 2);
-    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, 2 * (uint32_t) frame_index);
-
-    VkViewport viewport = {
-        .x = 0.0f,
-        .y = 0.0f,
-        .width = (float)swap_image_extent.width,
-        .height = (float)swap_image_extent.height,
-        .minDepth = 0.0f,
-        .maxDepth = 1.0f
-    };
-    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    bool direct = direct_present_supported && !draw_mandelbrot_back_frame && is_mandelbrot_frame_presentable(mandelbrot_front_frame_index);
+    VkOffset3D blit_offsets[2] = {};
+    if (direct) {
+        get_mandelbrot_blit_offsets(mandelbrot_front_frame_index, blit_offsets);
+    }
 
-    VkRect2D scissor = {
-        .offset = { 0, 0 },
-        .extent = swap_image_extent
-    };
-    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+    // The key past the back frames is the direct path
+    size_t mandelbrot_back_frame_key = direct ? NUM_MANDELBROT_FRAMES_IN_FLIGHT + 1 : (draw_mandelbrot_back_frame ? mandelbrot_back_frame_index + 1 : 0);
+    frame_command_buffer_t* frame_command_buffer = &frame_command_buffers[(((((frame_index * frame_command_buffer_image_capacity) + image_index) * NUM_MANDELBROT_FRAMES_IN_FLIGHT) + mandelbrot_front_frame_index) * (NUM_MANDELBROT_FRAMES_IN_FLIGHT + 2)) + mandelbrot_back_frame_key];
+    VkCommandBuffer command_buffer = frame_command_buffer->command_buffer;
 
-    vkCmdBeginRenderPass(command_buffer, &(VkRenderPassBeginInfo) {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .renderPass = frame_render_pass,
-        .framebuffer = swapchain_framebuffers[image_index],
-        .renderArea.offset = { 0, 0 },
-        .renderArea.extent = swap_image_extent,
-        .clearValueCount = 1,
-        .pClearValues = (VkClearValue[1]) {
-            { .color = { .float32 = { 0.62f, 0.78f, 1.0f, 1.0f } } }
+    // Command buffers of this frame in flight are done since its fence was waited on
+    if (!frame_command_buffer->recorded || frame_command_buffer->version != get_mandelbrot_render_pipeline_version() || memcmp(frame_command_buffer->blit_offsets, blit_offsets, sizeof(blit_offsets)) != 0) {
+        if ((result = record_frame_command_buffer(command_buffer, image_index, mandelbrot_front_frame_index, draw_mandelbrot_back_frame, mandelbrot_back_frame_index, direct, blit_offsets)) != result_success) {
+            return result;
         }
-    }, VK_SUBPASS_CONTENTS_INLINE);
-
-    size_t mandelbrot_front_frame_index = get_mandelbrot_front_frame_index();
-    mat3s tween_affine_map = glms_mat3_mul(glms_mat3_inv(mandelbrot_compute_affine_maps[mandelbrot_front_frame_index]), get_affine_map());
-    if ((result = draw_mandelbrot_render_pipeline(command_buffer, mandelbrot_front_frame_index, frame_index, &tween_affine_map)) != result_success) {
-        return result;
+        frame_command_buffer->recorded = true;
+        frame_command_buffer->version = get_mandelbrot_render_pipeline_version();
+        memcpy(frame_command_buffer->blit_offsets, blit_offsets, sizeof(blit_offsets));
     }
 
-    vkCmdEndRenderPass(command_buffer);
-
-    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, 2 * (uint32_t) frame_index + 1);
-
-    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-        return result_command_buffer_end_failure;
-    }
+    // The only things that change every frame, the command buffer just reads them. Latched as late as possible so that the most recent cursor movement makes it in
+    latch_camera();
+    camera_view_t view = get_camera_view();
+    mat3s tween_affine_map = get_mandelbrot_frame_tween_affine_map(mandelbrot_front_frame_index, &view);
+    mat3s back_tween_affine_map = get_mandelbrot_frame_tween_affine_map(mandelbrot_back_frame_index, &view);
+    write_mandelbrot_render_pipeline_parameters(frame_index, mandelbrot_front_frame_index, &tween_affine_map, mandelbrot_back_frame_index, &back_tween_affine_map);
+    frame_input_times[frame_index] = take_camera_input_time();
 
-    VkPipelineStageFlags wait_stage_flags = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    // Either path may be recorded, the blit waits in the transfer stage
+    VkPipelineStageFlags wait_stage_flags[2] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT };
     
+    // Binary semaphores ignore their timeline values
     if (vkQueueSubmit(graphics_queue, 1, &(VkSubmitInfo) {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &image_available_semaphore,
-        .pWaitDstStageMask = &wait_stage_flags,
+        .pNext = &(VkTimelineSemaphoreSubmitInfo) {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = 2,
+            .pWaitSemaphoreValues = (uint64_t[2]) { 0, mandelbrot_compute_wait_value },
+            .signalSemaphoreValueCount = 2,
+            .pSignalSemaphoreValues = (uint64_t[2]) { 0, render_value }
+        },
+        .waitSemaphoreCount = 2,
+        .pWaitSemaphores = (VkSemaphore[2]) { image_available_semaphore, mandelbrot_compute_semaphore },
+        .pWaitDstStageMask = wait_stage_flags,
         .commandBufferCount = 1,
         .pCommandBuffers = &command_buffer,
-        .signalSemaphoreCount = 1,
-        .pSignalSemaphores = &render_finished_semaphore
+        .signalSemaphoreCount = 2,
+        .pSignalSemaphores = (VkSemaphore[2]) { render_finished_semaphore, render_timeline_semaphore }
     }, in_flight_fence) != VK_SUCCESS) {
         return result_queue_submit_failure;
     }
+    render_timeline_value = render_value;
+    frame_present_times[frame_index] = get_current_microseconds();
 
     {
         VkResult result = vkQueuePresentKHR(presentation_queue, &(VkPresentInfoKHR) {
@@ -868,10 +1183,9 @@ result_t draw_gfx(microseconds_t* out_frame_render_time, microseconds_t* out_man
             .pImageIndices = &image_index
         });
         
-        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebuffer_resized) {
-            framebuffer_resized = false;
-            vkWaitForFences(device, 1, &in_flight_fence, VK_TRUE, UINT64_MAX);
-            reinit_swapchain();
+        // Recreated on the next frame without waiting on this one
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            swapchain_out_of_date = true;
         } else if (result != VK_SUCCESS) {
             return result_swapchain_image_present_failure;
         }
@@ -890,6 +1204,11 @@ result_t init_gfx() {
         return result;
     }
 
+    init_pacing();
+    if ((result = init_camera()) != result_success) {
+        return result;
+    }
+
     if ((result = init_vk_core()) != result_success) {
         return result;
     }
@@ -897,6 +1216,16 @@ result_t init_gfx() {
     return result_success;
 }
 
+// Only FIFO blocks in acquire until a refresh, other modes have to be paced by the caller
+bool is_gfx_present_throttled(void) {
+    return present_mode == VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// The displayed image is final, drawing again would present the same thing
+bool is_gfx_idle(void) {
+    return !swapchain_out_of_date && !framebuffer_resized && is_mandelbrot_management_idle();
+}
+
 bool should_window_close() {
     return glfwWindowShouldClose(window);
 }
@@ -2,6 +2,7 @@
 #include "chrono.h"
 #include "result.h"
 #include <GLFW/glfw3.h>
+#include <stdbool.h>
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
 
@@ -12,10 +13,10 @@ extern VkDevice device;
 extern VmaAllocator allocator;
 extern VkSurfaceFormatKHR surface_format;
 
-extern VkSampleCountFlagBits render_multisample_flags;
-extern VkRenderPass frame_render_pass;
-extern VkFence in_flight_fences[NUM_FRAMES_IN_FLIGHT];
+extern VkSemaphore render_timeline_semaphore;
 
 result_t init_gfx(void);
-result_t draw_gfx(microseconds_t* out_frame_render_time, microseconds_t* out_mandelbrot_frame_compute_time);
+result_t draw_gfx(microseconds_t* out_frame_render_time, microseconds_t* out_mandelbrot_frame_compute_time, microseconds_t* out_input_latency);
+bool is_gfx_present_throttled(void);
+bool is_gfx_idle(void);
 void term_gfx(void);
\ No newline at end of file
@@ -46,6 +46,21 @@ result_t create_shader_module(const char* path, VkShaderModule* shader_module) {
     return result_success;
 }
 
+result_t create_timeline_semaphore(VkSemaphore* semaphore) {
+    if (vkCreateSemaphore(device, &(VkSemaphoreCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &(VkSemaphoreTypeCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0
+        }
+    }, NULL, semaphore) != VK_SUCCESS) {
+        return result_synchronization_primitive_create_failure;
+    }
+
+    return result_success;
+}
+
 result_t write_to_buffer(VmaAllocation buffer_allocation, size_t num_bytes, const void* data) {
     void* mapped_data;
     if (vmaMapMemory(allocator, buffer_allocation, &mapped_data) != VK_SUCCESS) {
@@ -5,6 +5,7 @@
 #include <vulkan/vulkan.h>
 
 result_t create_shader_module(const char* path, VkShaderModule* shader_module);
+result_t create_timeline_semaphore(VkSemaphore* semaphore);
 result_t write_to_buffer(VmaAllocation buffer_allocation, size_t num_bytes, const void* data);
 
 typedef struct {
@@ -0,0 +1,292 @@
+#include "mandelbrot_batch.h"
+#include "gfx/default.h"
+#include "gfx/frame_graph.h"
+#include "gfx/gfx.h"
+#include "gfx/gfx_util.h"
+#include "gfx/mandelbrot_management.h"
+#include "gfx/pipeline.h"
+#include "result.h"
+#include "util.h"
+#include <stdint.h>
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan.h>
+
+VkImage mandelbrot_batch_image;
+VkImageView mandelbrot_batch_image_view;
+
+static VmaAllocation batch_image_allocation;
+static VkBuffer view_buffer;
+static VmaAllocation view_buffer_allocation;
+static mandelbrot_batch_view_t* view_data;
+
+static pipeline_t pipeline;
+static VkDescriptorSetLayout descriptor_set_layout;
+static VkDescriptorSet descriptor_set;
+
+static VkQueue batch_queue;
+static uint32_t batch_queue_family_indices[2];
+static VkDescriptorPool batch_descriptor_pool;
+// Nothing is created until the first batch is submitted, most runs never compute one
+static bool resources_created = false;
+static VkCommandPool command_pool;
+static VkCommandBuffer command_buffer;
+// Signaled once the last batch is done, created signaled so that the first batch does not wait
+static VkFence batch_fence;
+
+result_t init_mandelbrot_batch(VkQueue queue, const uint32_t queue_family_indices[2], VkDescriptorPool descriptor_pool) {
+    batch_queue = queue;
+    batch_queue_family_indices[0] = queue_family_indices[0];
+    batch_queue_family_indices[1] = queue_family_indices[1];
+    batch_descriptor_pool = descriptor_pool;
+
+    return result_success;
+}
+
+static result_t create_batch_resources(void) {
+    result_t result;
+
+    bool concurrent = batch_queue_family_indices[0] != batch_queue_family_indices[1];
+
+    if (vmaCreateImage(allocator, &(VkImageCreateInfo) {
+        DEFAULT_VK_IMAGE,
+        .format = MANDELBROT_COLOR_FORMAT,
+        .extent = { MANDELBROT_BATCH_VIEW_SIZE, MANDELBROT_BATCH_VIEW_SIZE, 1 },
+        .arrayLayers = MANDELBROT_BATCH_MAX_VIEWS,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = concurrent ? 2 : 0,
+        .pQueueFamilyIndices = batch_queue_family_indices
+    }, &device_allocation_create_info, &mandelbrot_batch_image, &batch_image_allocation, NULL) != VK_SUCCESS) {
+        return result_image_create_failure;
+    }
+
+    if (vkCreateImageView(device, &(VkImageViewCreateInfo) {
+        DEFAULT_VK_IMAGE_VIEW,
+        .image = mandelbrot_batch_image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+        .format = MANDELBROT_COLOR_FORMAT,
+        .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .subresourceRange.layerCount = MANDELBROT_BATCH_MAX_VIEWS
+    }, NULL, &mandelbrot_batch_image_view) != VK_SUCCESS) {
+        return result_image_view_create_failure;
+    }
+
+    {
+        VmaAllocationInfo view_buffer_allocation_info;
+        if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+            DEFAULT_VK_STORAGE_BUFFER,
+            .size = MANDELBROT_BATCH_MAX_VIEWS * sizeof(mandelbrot_batch_view_t)
+        }, &mapped_shared_write_allocation_create_info, &view_buffer, &view_buffer_allocation, &view_buffer_allocation_info) != VK_SUCCESS) {
+            return result_buffer_create_failure;
+        }
+        view_data = view_buffer_allocation_info.pMappedData;
+    }
+
+    VkShaderModule shader_module;
+    if ((result = create_shader_module("shader/mandelbrot_batch.spv", &shader_module)) != result_success) {
+        return result;
+    }
+
+    if (vkCreateDescriptorSetLayout(device, &(VkDescriptorSetLayoutCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 2,
+        .pBindings = (VkDescriptorSetLayoutBinding[2]) {
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 0,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            }
+        }
+    }, NULL, &descriptor_set_layout) != VK_SUCCESS) {
+        return result_descriptor_set_layout_create_failure;
+    }
+
+    if (vkAllocateDescriptorSets(device, &(VkDescriptorSetAllocateInfo) {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = batch_descriptor_pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &descriptor_set_layout
+    }, &descriptor_set) != VK_SUCCESS) {
+        return result_descriptor_sets_allocate_failure;
+    }
+
+    // Nothing the set points at ever changes
+    vkUpdateDescriptorSets(device, 2, (VkWriteDescriptorSet[2]) {
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = 0,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 1,
+            .pImageInfo = &(VkDescriptorImageInfo) {
+                .imageView = mandelbrot_batch_image_view,
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = 1,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = view_buffer,
+                .offset = 0,
+                .range = VK_WHOLE_SIZE
+            }
+        }
+    }, 0, NULL);
+
+    if (vkCreatePipelineLayout(device, &(VkPipelineLayoutCreateInfo) {
+        DEFAULT_VK_PIPELINE_LAYOUT,
+        .setLayoutCount = 1,
+        .pSetLayouts = &descriptor_set_layout
+    }, NULL, &pipeline.pipeline_layout) != VK_SUCCESS) {
+        return result_pipeline_layout_create_failure;
+    }
+
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &(VkComputePipelineCreateInfo) {
+        DEFAULT_VK_COMPUTE_PIPELINE,
+        .stage = {
+            DEFAULT_VK_SHADER_STAGE,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = shader_module
+        },
+        .layout = pipeline.pipeline_layout
+    }, NULL, &pipeline.pipeline) != VK_SUCCESS) {
+        return result_compute_pipelines_create_failure;
+    }
+
+    vkDestroyShaderModule(device, shader_module, NULL);
+
+    if (vkCreateCommandPool(device, &(VkCommandPoolCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = batch_queue_family_indices[1]
+    }, NULL, &command_pool) != VK_SUCCESS) {
+        return result_command_pool_create_failure;
+    }
+
+    if (vkAllocateCommandBuffers(device, &(VkCommandBufferAllocateInfo) {
+        DEFAULT_VK_COMMAND_BUFFER,
+        .commandPool = command_pool
+    }, &command_buffer) != VK_SUCCESS) {
+        return result_command_buffers_allocate_failure;
+    }
+
+    if (vkCreateFence(device, &(VkFenceCreateInfo) {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .flags = VK_FENCE_CREATE_SIGNALED_BIT
+    }, NULL, &batch_fence) != VK_SUCCESS) {
+        return result_synchronization_primitive_create_failure;
+    }
+
+    resources_created = true;
+    return result_success;
+}
+
+static void record_batch_dispatch(VkCommandBuffer command_buffer, const void* data) {
+    uint32_t num_views = *(const uint32_t*) data;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline_layout, 0, 1, &descriptor_set, 0, NULL);
+    vkCmdDispatch(command_buffer, MANDELBROT_BATCH_VIEW_SIZE / 8, MANDELBROT_BATCH_VIEW_SIZE / 8, num_views);
+}
+
+// Computes views into the first num_views layers with a single dispatch and submission, and returns without waiting for them
+// A batch still in flight shares the view buffer and the image, while it is nothing is submitted and out_submitted is false so the caller can try again later
+result_t submit_mandelbrot_batch(uint32_t num_views, const mat3s affine_maps[], bool* out_submitted) {
+    *out_submitted = false;
+
+    num_views = clamp_uint32(num_views, 0, MANDELBROT_BATCH_MAX_VIEWS);
+    if (num_views == 0) {
+        return result_success;
+    }
+
+    if (!resources_created) {
+        result_t result;
+        if ((result = create_batch_resources()) != result_success) {
+            return result;
+        }
+    }
+
+    if (!is_mandelbrot_batch_done()) {
+        return result_success;
+    }
+    if (vkResetFences(device, 1, &batch_fence) != VK_SUCCESS) {
+        return result_fences_reset_failure;
+    }
+    if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
+        return result_command_buffer_reset_failure;
+    }
+
+    for (uint32_t i = 0; i < num_views; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            view_data[i].affine_map[j].col = affine_maps[i].col[j];
+        }
+    }
+
+    if (vkBeginCommandBuffer(command_buffer, &(VkCommandBufferBeginInfo) {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    }) != VK_SUCCESS) {
+        return result_command_buffer_begin_failure;
+    }
+
+    frame_graph_t graph;
+    init_frame_graph(&graph);
+
+    uint32_t batch_image = add_frame_graph_image(&graph, mandelbrot_batch_image, num_views, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED });
+    // Whatever the layers held before is discarded
+    add_frame_graph_pass(&graph, record_batch_dispatch, &num_views, 1, (frame_graph_access_t[]) {
+        { batch_image, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, true }
+    });
+
+    record_frame_graph(&graph, command_buffer);
+
+    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+        return result_command_buffer_end_failure;
+    }
+
+    if (vkQueueSubmit(batch_queue, 1, &(VkSubmitInfo) {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer
+    }, batch_fence) != VK_SUCCESS) {
+        return result_queue_submit_failure;
+    }
+
+    *out_submitted = true;
+    return result_success;
+}
+
+// Once true the layers of the last batch may be read, and another batch can be submitted
+bool is_mandelbrot_batch_done(void) {
+    return !resources_created || vkGetFenceStatus(device, batch_fence) == VK_SUCCESS;
+}
+
+void term_mandelbrot_batch(void) {
+    if (!resources_created) {
+        return;
+    }
+
+    vkWaitForFences(device, 1, &batch_fence, VK_TRUE, UINT64_MAX);
+    vkDestroyFence(device, batch_fence, NULL);
+    vkDestroyCommandPool(device, command_pool, NULL);
+
+    destroy_pipeline(&pipeline);
+    vkDestroyDescriptorSetLayout(device, descriptor_set_layout, NULL);
+
+    vmaDestroyBuffer(allocator, view_buffer, view_buffer_allocation);
+    vkDestroyImageView(device, mandelbrot_batch_image_view, NULL);
+    vmaDestroyImage(allocator, mandelbrot_batch_image, batch_image_allocation);
+}
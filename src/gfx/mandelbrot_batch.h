@@ -0,0 +1,28 @@
+#pragma once
+#include "result.h"
+#include <cglm/types-struct.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// Small independent views such as thumbnails, computed together into the layers of one image
+#define MANDELBROT_BATCH_MAX_VIEWS 16
+#define MANDELBROT_BATCH_VIEW_SIZE 256
+
+// Must match view_t in mandelbrot_batch.comp
+typedef struct {
+    struct {
+        alignas(16) vec3s col;
+    } affine_map[3];
+} mandelbrot_batch_view_t;
+
+// A layer per view in MANDELBROT_COLOR_FORMAT, stays in the general layout for its whole lifetime. Created along with the rest on the first submission
+extern VkImage mandelbrot_batch_image;
+// Covers every layer
+extern VkImageView mandelbrot_batch_image_view;
+
+result_t init_mandelbrot_batch(VkQueue queue, const uint32_t queue_family_indices[2], VkDescriptorPool descriptor_pool);
+// Only from the render thread, the queue is the compute queue manage_mandelbrot_frames submits to and queue submissions have to be externally synchronized
+result_t submit_mandelbrot_batch(uint32_t num_views, const mat3s affine_maps[], bool* out_submitted);
+bool is_mandelbrot_batch_done(void);
+void term_mandelbrot_batch(void);
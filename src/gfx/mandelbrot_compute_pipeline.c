@@ -1,23 +1,24 @@
 #include "mandelbrot_compute_pipeline.h"
 #include "gfx/default.h"
+#include "gfx/frame_graph.h"
 #include "gfx/gfx.h"
 #include "gfx/gfx_util.h"
 #include "gfx/mandelbrot_management.h"
+#include "gfx/mandelbrot_page_cache.h"
 #include "gfx/pipeline.h"
 #include "result.h"
 #include <cglm/types-struct.h>
+#include <stddef.h>
 #include <vulkan/vulkan.h>
 
-typedef struct {
-    struct {
-        alignas(16) vec3s col;
-    } affine_map[3];
-} push_constants_t;
-
 static pipeline_t pipeline;
+// Share the pipeline layout, and so the descriptor set, with the kernel
+static VkPipeline classify_pipeline;
+static VkPipeline page_pipeline;
 
 static VkDescriptorSetLayout descriptor_set_layout;
-static VkDescriptorSet descriptor_set;
+// Written once per image, everything that changes between chunks is in the parameter ring
+static VkDescriptorSet descriptor_sets[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 
 result_t init_mandelbrot_compute_pipeline(VkDescriptorPool descriptor_pool) {
     result_t result;
@@ -27,28 +28,105 @@ result_t init_mandelbrot_compute_pipeline(VkDescriptorPool descriptor_pool) {
         return result;
     }
 
+    VkShaderModule classify_shader_module;
+    if ((result = create_shader_module("shader/mandelbrot_classify.spv", &classify_shader_module)) != result_success) {
+        return result;
+    }
+
+    VkShaderModule page_shader_module;
+    if ((result = create_shader_module("shader/mandelbrot_page.spv", &page_shader_module)) != result_success) {
+        return result;
+    }
+
     if (vkCreateDescriptorSetLayout(device, &(VkDescriptorSetLayoutCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .bindingCount = 1,
-        .pBindings = (VkDescriptorSetLayoutBinding[1]) {
+        .bindingCount = 11,
+        .pBindings = (VkDescriptorSetLayoutBinding[11]) {
             {
                 DEFAULT_VK_DESCRIPTOR_BINDING,
                 .binding = 0,
                 .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
                 .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 2,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 3,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 4,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 5,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 6,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 7,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 8,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 9,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 10,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
             }
         }
     }, NULL, &descriptor_set_layout) != VK_SUCCESS) {
         return result_descriptor_set_layout_create_failure;
     }
 
-    if (vkAllocateDescriptorSets(device, &(VkDescriptorSetAllocateInfo) {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-        .descriptorPool = descriptor_pool,
-        .descriptorSetCount = 1,
-        .pSetLayouts = &descriptor_set_layout
-    }, &descriptor_set) != VK_SUCCESS) {
-        return result_descriptor_sets_allocate_failure;
+    {
+        VkDescriptorSetLayout set_layouts[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+        for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
+            set_layouts[i] = descriptor_set_layout;
+        }
+
+        if (vkAllocateDescriptorSets(device, &(VkDescriptorSetAllocateInfo) {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = descriptor_pool,
+            .descriptorSetCount = NUM_MANDELBROT_FRAMES_IN_FLIGHT,
+            .pSetLayouts = set_layouts
+        }, descriptor_sets) != VK_SUCCESS) {
+            return result_descriptor_sets_allocate_failure;
+        }
     }
 
     if (vkCreatePipelineLayout(device, &(VkPipelineLayoutCreateInfo) {
@@ -56,11 +134,6 @@ result_t init_mandelbrot_compute_pipeline(VkDescriptorPool descriptor_pool) {
         .setLayoutCount = 1,
         .pSetLayouts = (VkDescriptorSetLayout[1]) {
             descriptor_set_layout
-        },
-        .pushConstantRangeCount = 1,
-        .pPushConstantRanges = &(VkPushConstantRange) {
-            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
-            .size = sizeof(push_constants_t)
         }
     }, NULL, &pipeline.pipeline_layout) != VK_SUCCESS) {
         return result_pipeline_layout_create_failure;
@@ -78,16 +151,42 @@ result_t init_mandelbrot_compute_pipeline(VkDescriptorPool descriptor_pool) {
         return result_compute_pipelines_create_failure;
     }
 
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &(VkComputePipelineCreateInfo) {
+        DEFAULT_VK_COMPUTE_PIPELINE,
+        .stage = {
+            DEFAULT_VK_SHADER_STAGE,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = classify_shader_module
+        },
+        .layout = pipeline.pipeline_layout
+    }, NULL, &classify_pipeline) != VK_SUCCESS) {
+        return result_compute_pipelines_create_failure;
+    }
+
+    if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &(VkComputePipelineCreateInfo) {
+        DEFAULT_VK_COMPUTE_PIPELINE,
+        .stage = {
+            DEFAULT_VK_SHADER_STAGE,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = page_shader_module
+        },
+        .layout = pipeline.pipeline_layout
+    }, NULL, &page_pipeline) != VK_SUCCESS) {
+        return result_compute_pipelines_create_failure;
+    }
+
+    vkDestroyShaderModule(device, page_shader_module, NULL);
+    vkDestroyShaderModule(device, classify_shader_module, NULL);
     vkDestroyShaderModule(device, shader_module, NULL);
 
     return result_success;
 }
 
 void update_mandelbrot_compute_pipeline(size_t frame_index) {
-    vkUpdateDescriptorSets(device, 1, (VkWriteDescriptorSet[1]) {
+    vkUpdateDescriptorSets(device, 11, (VkWriteDescriptorSet[11]) {
         {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = descriptor_set,
+            .dstSet = descriptor_sets[frame_index],
             .dstBinding = 0,
             .dstArrayElement = 0,
             .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
@@ -97,65 +196,291 @@ void update_mandelbrot_compute_pipeline(size_t frame_index) {
                 .imageLayout = VK_IMAGE_LAYOUT_GENERAL
             }
         },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 1,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = mandelbrot_tile_buffers[frame_index],
+                .offset = 0,
+                .range = VK_WHOLE_SIZE
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 2,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = mandelbrot_generation_buffer,
+                .offset = 0,
+                .range = VK_WHOLE_SIZE
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 3,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = mandelbrot_rate_buffers[frame_index],
+                .offset = 0,
+                .range = VK_WHOLE_SIZE
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 4,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = mandelbrot_work_buffers[frame_index],
+                .offset = 0,
+                .range = VK_WHOLE_SIZE
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 5,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = mandelbrot_parameter_buffer,
+                .offset = frame_index * MANDELBROT_PARAMETER_STRIDE,
+                .range = sizeof(mandelbrot_compute_parameters_t)
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 6,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 1,
+            .pImageInfo = &(VkDescriptorImageInfo) {
+                .imageView = mandelbrot_page_atlas_image_view,
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 7,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = mandelbrot_page_table_buffer,
+                .offset = 0,
+                .range = VK_WHOLE_SIZE
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 8,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = mandelbrot_page_request_buffer,
+                .offset = 0,
+                .range = VK_WHOLE_SIZE
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 9,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = mandelbrot_page_transfer_buffer,
+                .offset = 0,
+                .range = VK_WHOLE_SIZE
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_sets[frame_index],
+            .dstBinding = 10,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 1,
+            .pImageInfo = &(VkDescriptorImageInfo) {
+                .imageView = mandelbrot_iteration_image_views[frame_index],
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+            }
+        }
     }, 0, NULL);
 }
 
-void record_mandelbrot_compute_pipeline_init_to_fragment_transition(VkCommandBuffer command_buffer, size_t frame_index) {
-    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &(VkImageMemoryBarrier) {
-        DEFAULT_VK_IMAGE_MEMORY_BARRIER,
-        .image = mandelbrot_color_images[frame_index],
-        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+// Mandelbrot color images stay in the general layout for their whole lifetime since a frame that is still being computed is sampled by the render pipeline between tile chunks
+// These are recorded on the compute queue, which cannot reference fragment stages, reads by the render pipeline are ordered by the timeline semaphores instead
+// Both kinds of buffers and the images are concurrent, the graphs never transfer ownership
+static void record_color_image_clear(VkCommandBuffer command_buffer, const void* data) {
+    size_t frame_index = *(const size_t*) data;
+
+    VkImageSubresourceRange range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+    };
+
+    // Cleared to transparent so that tiles which have not been computed yet do not cover the previous frame, and to zero iterations which means the same
+    vkCmdClearColorImage(command_buffer, mandelbrot_color_images[frame_index], VK_IMAGE_LAYOUT_GENERAL, &(VkClearColorValue) {
+        .float32 = { 0.0f, 0.0f, 0.0f, 0.0f }
+    }, 1, &range);
+    vkCmdClearColorImage(command_buffer, mandelbrot_iteration_images[frame_index], VK_IMAGE_LAYOUT_GENERAL, &(VkClearColorValue) {
+        .uint32 = { 0, 0, 0, 0 }
+    }, 1, &range);
+}
+
+static void record_rate_copy(VkCommandBuffer command_buffer, const void* data) {
+    size_t frame_index = *(const size_t*) data;
+
+    // Rates are copied on the gpu so that they are ordered after the rendered frames that still read the old ones
+    vkCmdCopyBuffer(command_buffer, mandelbrot_rate_staging_buffers[frame_index], mandelbrot_rate_buffers[frame_index], 1, &(VkBufferCopy) {
+        .size = get_mandelbrot_tile_capacity(frame_index) * sizeof(uint32_t)
     });
 }
 
-void record_mandelbrot_compute_pipeline_init_to_compute_transition(VkCommandBuffer command_buffer, size_t frame_index) {
-    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &(VkImageMemoryBarrier) {
-        DEFAULT_VK_IMAGE_MEMORY_BARRIER,
-        .image = mandelbrot_color_images[frame_index],
-        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
-        .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT
+// Starts a new frame in the image, whatever was in there before is discarded
+void record_mandelbrot_compute_pipeline_begin(VkCommandBuffer command_buffer, size_t frame_index) {
+    frame_graph_t graph;
+    init_frame_graph(&graph);
+
+    uint32_t color_image = add_frame_graph_image(&graph, mandelbrot_color_images[frame_index], 1, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
+    uint32_t iteration_image = add_frame_graph_image(&graph, mandelbrot_iteration_images[frame_index], 1, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
+    uint32_t rate_buffer = add_frame_graph_buffer(&graph, mandelbrot_rate_buffers[frame_index], &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED });
+
+    add_frame_graph_pass(&graph, record_color_image_clear, &frame_index, 2, (frame_graph_access_t[]) {
+        { color_image, { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, true },
+        { iteration_image, { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, true }
+    });
+    add_frame_graph_pass(&graph, record_rate_copy, &frame_index, 1, (frame_graph_access_t[]) {
+        { rate_buffer, { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED }, false }
+    });
+    add_frame_graph_pass(&graph, NULL, NULL, 3, (frame_graph_access_t[]) {
+        { rate_buffer, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED }, false },
+        { color_image, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, false },
+        { iteration_image, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, false }
     });
+
+    record_frame_graph(&graph, command_buffer);
 }
 
-void record_mandelbrot_compute_pipeline_fragment_to_compute_transition(VkCommandBuffer command_buffer, size_t frame_index) {
-    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &(VkImageMemoryBarrier) {
-        DEFAULT_VK_IMAGE_MEMORY_BARRIER,
-        .image = mandelbrot_color_images[frame_index],
-        .oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_GENERAL,
-        .srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
-        .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT
+// Only for frames computed on the graphics queue, which no timeline semaphore orders against rendering
+void record_mandelbrot_compute_pipeline_compute_to_fragment_transition(VkCommandBuffer command_buffer, size_t frame_index) {
+    frame_graph_t graph;
+    init_frame_graph(&graph);
+
+    uint32_t rate_buffer = add_frame_graph_buffer(&graph, mandelbrot_rate_buffers[frame_index], &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED });
+    uint32_t color_image = add_frame_graph_image(&graph, mandelbrot_color_images[frame_index], 1, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
+    uint32_t iteration_image = add_frame_graph_image(&graph, mandelbrot_iteration_images[frame_index], 1, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
+
+    add_frame_graph_pass(&graph, NULL, NULL, 3, (frame_graph_access_t[]) {
+        { rate_buffer, { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED }, false },
+        { color_image, { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL }, false },
+        { iteration_image, { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL }, false }
     });
+
+    record_frame_graph(&graph, command_buffer);
 }
 
-void record_mandelbrot_compute_pipeline(VkCommandBuffer command_buffer, size_t frame_index, const mat3s* affine_map) {
-    push_constants_t push_constants;
-    for (size_t i = 0; i < 3; i++) {
-        push_constants.affine_map[i].col = affine_map->col[i];
-    }
+static void record_work_reset(VkCommandBuffer command_buffer, const void* data) {
+    size_t frame_index = *(const size_t*) data;
+
+    // The classification pass counts the workgroups up from zero, a tile that needs the kernel takes MANDELBROT_TILE_GROUPS by MANDELBROT_TILE_GROUPS of them
+    vkCmdUpdateBuffer(command_buffer, mandelbrot_work_buffers[frame_index], 0, sizeof(VkDispatchIndirectCommand), &(VkDispatchIndirectCommand) { 0, MANDELBROT_TILE_GROUPS, 1 });
+}
 
+static void record_page_dispatch(VkCommandBuffer command_buffer, const void* data) {
+    size_t frame_index = *(const size_t*) data;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, page_pipeline);
+    vkCmdDispatchIndirect(command_buffer, mandelbrot_parameter_buffer, (frame_index * MANDELBROT_PARAMETER_STRIDE) + offsetof(mandelbrot_compute_parameters_t, page_command));
+}
+
+static void record_classify_dispatch(VkCommandBuffer command_buffer, const void* data) {
+    size_t frame_index = *(const size_t*) data;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, classify_pipeline);
+    vkCmdDispatchIndirect(command_buffer, mandelbrot_parameter_buffer, (frame_index * MANDELBROT_PARAMETER_STRIDE) + offsetof(mandelbrot_compute_parameters_t, classify_command));
+}
+
+static void record_kernel_dispatch(VkCommandBuffer command_buffer, const void* data) {
+    size_t frame_index = *(const size_t*) data;
+
+    // Listed tiles are laid out side by side along x, the size of the dispatch never comes back to the cpu
     vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline);
+    vkCmdDispatchIndirect(command_buffer, mandelbrot_work_buffers[frame_index], 0);
+}
 
-    vkCmdPushConstants(command_buffer, pipeline.pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+// Nothing in here changes from chunk to chunk, the chunk's tiles and the rest are read from the parameter entry of the frame
+void record_mandelbrot_compute_pipeline(VkCommandBuffer command_buffer, size_t frame_index) {
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline_layout, 0, 1, &descriptor_sets[frame_index], 0, NULL);
 
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.pipeline_layout, 0, 1, &descriptor_set, 0, NULL);
-    
-    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    frame_graph_t graph;
+    init_frame_graph(&graph);
 
-    vkCmdDispatch(command_buffer, dispatch->width, dispatch->height, 1);
+    // The work list of the previous chunk may still be read by its indirect dispatch
+    uint32_t work_buffer = add_frame_graph_buffer(&graph, mandelbrot_work_buffers[frame_index], &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED });
+    // The atlas, the page transfer buffer and the rest the page pass touches
+    uint32_t pages = add_frame_graph_memory(&graph, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED });
+    uint32_t color_image = add_frame_graph_image(&graph, mandelbrot_color_images[frame_index], 1, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
+    uint32_t iteration_image = add_frame_graph_image(&graph, mandelbrot_iteration_images[frame_index], 1, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL });
 
-    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &(VkImageMemoryBarrier) {
-        DEFAULT_VK_IMAGE_MEMORY_BARRIER,
-        .image = mandelbrot_color_images[frame_index],
-        .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
-        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+    // Independent of each other, so they share a barrier and may overlap
+    add_frame_graph_pass(&graph, record_work_reset, &frame_index, 1, (frame_graph_access_t[]) {
+        { work_buffer, { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED }, false }
+    });
+    // Requested pages are filled first, computed ones are only looked up once the chunk is done but uploaded ones are read by the classification pass right after
+    add_frame_graph_pass(&graph, record_page_dispatch, &frame_index, 1, (frame_graph_access_t[]) {
+        { pages, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED }, false }
+    });
+    // The host reads computed pages back from the transfer buffer for the page file
+    add_frame_graph_pass(&graph, NULL, NULL, 1, (frame_graph_access_t[]) {
+        { pages, { VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED }, false }
     });
+    // One workgroup per tile, uniform tiles and those whose pages are all there are filled and the rest are listed for the kernel
+    // Accumulated samples read back the color they are averaged into
+    add_frame_graph_pass(&graph, record_classify_dispatch, &frame_index, 4, (frame_graph_access_t[]) {
+        { pages, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED }, false },
+        { work_buffer, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED }, false },
+        { color_image, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, false },
+        { iteration_image, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, false }
+    });
+    add_frame_graph_pass(&graph, record_kernel_dispatch, &frame_index, 3, (frame_graph_access_t[]) {
+        { work_buffer, { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED }, false },
+        { color_image, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, false },
+        { iteration_image, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, false }
+    });
+    // Mapped iteration images are read back once to check the kernel against the cpu reference
+    add_frame_graph_pass(&graph, NULL, NULL, 1, (frame_graph_access_t[]) {
+        { iteration_image, { VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL }, false }
+    });
+
+    record_frame_graph(&graph, command_buffer);
 }
 
 void term_mandelbrot_compute_pipeline(void) {
+    vkDestroyPipeline(device, page_pipeline, NULL);
+    vkDestroyPipeline(device, classify_pipeline, NULL);
     destroy_pipeline(&pipeline);
 
     vkDestroyDescriptorSetLayout(device, descriptor_set_layout, NULL);
@@ -4,64 +4,647 @@
 #include "gfx/gfx.h"
 #include "gfx/gfx_util.h"
 #include "gfx/mandelbrot_compute_pipeline.h"
+#include "gfx/mandelbrot_page_cache.h"
 #include "gfx/mandelbrot_render_pipeline.h"
+#include "mandelbrot_cpu.h"
+#include "pacing.h"
 #include "result.h"
 #include "util.h"
+#include <cglm/struct/affine2d.h>
+#include <cglm/struct/mat3.h>
+#include <cglm/struct/vec2.h>
+#include <cglm/util.h>
+#include <math.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan_core.h>
 
+typedef struct {
+    mandelbrot_tile_t tile;
+    float priority;
+} prioritized_tile_t;
+
+// The resources of an image that was replaced, destroyed once the gpu is done with the frames that used them
+typedef struct {
+    bool pending;
+    uint64_t compute_value;
+    uint64_t render_value;
+    VkImage color_image;
+    VmaAllocation color_image_allocation;
+    VkImageView color_image_view;
+    VkImage iteration_image;
+    VmaAllocation iteration_image_allocation;
+    VkImageView iteration_image_view;
+    VkBuffer buffers[4];
+    VmaAllocation buffer_allocations[4];
+} retired_mandelbrot_image_t;
+
 static size_t front_frame_index = 0;
+static size_t back_frame_index = 1;
 
 VkImage mandelbrot_color_images[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 VkImageView mandelbrot_color_image_views[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+void* mandelbrot_color_image_data[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+size_t mandelbrot_color_image_row_pitches[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+VkImage mandelbrot_iteration_images[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+VkImageView mandelbrot_iteration_image_views[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+void* mandelbrot_iteration_image_data[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+size_t mandelbrot_iteration_image_row_pitches[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+VkBuffer mandelbrot_tile_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+VkBuffer mandelbrot_rate_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+VkBuffer mandelbrot_rate_staging_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+VkBuffer mandelbrot_work_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 mandelbrot_dispatch_t mandelbrot_dispatches[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
-size_t mandelbrot_frame_index_to_render_frame_index[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+VkBuffer mandelbrot_generation_buffer;
+VkBuffer mandelbrot_parameter_buffer;
+
+VkSemaphore mandelbrot_compute_semaphore;
+uint64_t mandelbrot_frame_compute_values[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+uint64_t mandelbrot_frame_render_values[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 
 static VmaAllocation mandelbrot_color_image_allocations[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
-static VkFence mandelbrot_fences[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
-static VkCommandBuffer mandelbrot_command_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static VmaAllocation mandelbrot_iteration_image_allocations[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static VmaAllocation mandelbrot_tile_buffer_allocations[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static VmaAllocation mandelbrot_rate_buffer_allocations[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static VmaAllocation mandelbrot_rate_staging_buffer_allocations[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static uint32_t* mandelbrot_rate_staging_data[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static VmaAllocation mandelbrot_work_buffer_allocations[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static VmaAllocation mandelbrot_generation_buffer_allocation;
+static VmaAllocation mandelbrot_parameter_buffer_allocation;
+static void* mandelbrot_parameter_data;
+// Recorded whenever a frame's image is created and resubmitted as is after that, starting a frame submits both
+static VkCommandBuffer mandelbrot_begin_command_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static VkCommandBuffer mandelbrot_chunk_command_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+
+// At most one per frame, the render descriptor sets are only double buffered
+static retired_mandelbrot_image_t retired_mandelbrot_images[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 
 mat3s mandelbrot_compute_affine_maps[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+// The view each frame was computed for, without the overscan
+static camera_view_t frame_views[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static uint32_t frame_num_samples[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+static bool frame_foveated[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+// Picked for the frame at full resolution, lower resolution frames just read finer pages
+static int32_t frame_page_levels[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+
+// Picked once at init, see should_map_mandelbrot_color_images
+static bool color_images_mapped = false;
 
 static VkQueue mandelbrot_queue;
+// Color images are written on the compute queue family and sampled on the graphics queue family
+static uint32_t mandelbrot_queue_family_indices[2];
 static VkCommandPool mandelbrot_command_pool;
 
 static VkQueryPool mandelbrot_timestamp_query_pool;
 
-static result_t create_mandelbrot_image(size_t frame_index, uint32_t width, uint32_t height) {
-    mandelbrot_dispatches[frame_index] = (mandelbrot_dispatch_t) { width / 8, height / 8 };
+// Every submitted tile chunk signals the next value of the compute timeline semaphore
+static uint64_t mandelbrot_compute_value = 0;
+
+// The back frame is computed over several rendered frames, one tile chunk at a time
+// While the camera is still the back frame is the front frame itself, accumulating one more jittered sample per pass
+static bool back_frame_in_progress = false;
+static uint32_t back_frame_sample_index = 0;
+static uint32_t num_back_frame_submitted_tiles = 0;
+static uint32_t num_chunk_tiles = 0;
+static microseconds_t back_frame_compute_time = 0;
+static microseconds_t back_frame_begin_time = 0;
+// Tiles of new frames are split between the gpu, which takes them from the front of the tile list, and the cpu workers, which take them from the back
+// Only with mapped color images, which the workers write into directly
+static bool hybrid = false;
+static mandelbrot_tile_t* back_frame_tiles = NULL;
+static uint32_t back_frame_tile_capacity = 0;
+static uint32_t num_back_frame_cpu_tiles = 0;
+static microseconds_t back_frame_cpu_compute_time = 0;
+// Tiles handed to the workers that they may not be done with, none are handed out until they are
+static uint32_t num_cpu_batch_tiles = 0;
+static bool cpu_batch_cancelled = false;
+// A batch is reserved first and only started once the rendered frames that drew its tiles before they were left out are done, until then the gpu may still sample them
+static bool cpu_batch_started = false;
+static uint64_t cpu_batch_render_value = 0;
+// The first frame the gpu computes is checked against the cpu reference, only possible when the images are mapped
+static bool gpu_kernel_checked = false;
+// Wall time per tile with every worker on it, which is throughput just like the gpu time per tile
+static float cpu_tile_compute_time = (float) MANDELBROT_COMPUTE_BUDGET / 4.0f;
+// Set when every sample and page of the still view is done, see is_mandelbrot_management_idle
+static bool idle = false;
+// Time from beginning a frame until all of its tiles are done, used to predict where the camera will be by then
+static microseconds_t frame_latency = 0;
+static float tile_compute_time = (float) MANDELBROT_COMPUTE_BUDGET / 16.0f;
+// Pages computed by the chunk in flight, which only ever computes pages or tiles but may upload pages from the page file either way
+static uint32_t num_chunk_pages = 0;
+static float page_compute_time = (float) MANDELBROT_COMPUTE_BUDGET / 16.0f;
+// Kept apart from the values of the frames since rendering has no reason to wait on pages
+static uint64_t page_chunk_compute_value = 0;
+// Bumped whenever the back frame is abandoned, dispatches of an older generation stop as soon as they see the new one
+static uint32_t generation = 0;
+static bool chunk_cancelled = false;
+static uint32_t overscan_margin = MANDELBROT_OVERSCAN_MIN_MARGIN;
+// Fraction of the framebuffer resolution frames are computed at while the camera moves, unquantized
+static float resolution_scale = 1.0f;
+
+uint32_t get_num_mandelbrot_tiles(size_t frame_index) {
+    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    return div_ceil_uint32(dispatch->width, MANDELBROT_TILE_GROUPS) * div_ceil_uint32(dispatch->height, MANDELBROT_TILE_GROUPS);
+}
+
+// How many tiles the buffers of the image have room for, which is what the recorded command buffers work with
+uint32_t get_mandelbrot_tile_capacity(size_t frame_index) {
+    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    return div_ceil_uint32(dispatch->image_width, MANDELBROT_TILE_SIZE) * div_ceil_uint32(dispatch->image_height, MANDELBROT_TILE_SIZE);
+}
+
+// Rounds up to the next of four steps per power of two, so that an image can grow by up to a quarter before it is reallocated
+static uint32_t get_mandelbrot_image_size_class(uint32_t size) {
+    uint32_t power = MANDELBROT_TILE_SIZE;
+    while (2 * power <= size) {
+        power *= 2;
+    }
+    return ceil_pow2(size, power / 4);
+}
+
+// Only changes which part of the image the frame uses, the image has to fit it
+static void set_mandelbrot_dispatch(size_t frame_index, uint32_t framebuffer_width, uint32_t framebuffer_height, uint32_t margin, float scale) {
+    mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    dispatch->width = ceil_pow2((uint32_t) ceilf((float) (framebuffer_width + (2 * margin)) * scale), 8) / 8;
+    dispatch->height = ceil_pow2((uint32_t) ceilf((float) (framebuffer_height + (2 * margin)) * scale), 8) / 8;
+    dispatch->framebuffer_width = framebuffer_width;
+    dispatch->framebuffer_height = framebuffer_height;
+    dispatch->margin = margin;
+    dispatch->scale = scale;
+}
+
+// Linear images the host writes into in place are only worth it where the device reads them about as fast as its own memory, on a discrete gpu without a resizable BAR every sample would cross the bus
+static bool should_map_mandelbrot_color_images(VkPhysicalDevice physical_device) {
+    VkPhysicalDeviceProperties physical_device_properties;
+    vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    VkDeviceSize device_local_heap_size = 0;
+    for (size_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        if ((memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && memory_properties.memoryHeaps[i].size > device_local_heap_size) {
+            device_local_heap_size = memory_properties.memoryHeaps[i].size;
+        }
+    }
+
+    // Must match the required flags of mapped_device_write_allocation_create_info
+    VkDeviceSize mapped_heap_size = 0;
+    VkMemoryPropertyFlags required_flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (size_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        VkDeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[i].heapIndex].size;
+        if ((memory_properties.memoryTypes[i].propertyFlags & required_flags) == required_flags && heap_size > mapped_heap_size) {
+            mapped_heap_size = heap_size;
+        }
+    }
+    if (mapped_heap_size == 0) {
+        return false;
+    }
+
+    // A discrete gpu without a resizable BAR still has a small host visible window into its memory, only a window over at least 90% of it counts
+    bool unified_memory = physical_device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+    if (!unified_memory && mapped_heap_size * 10 < device_local_heap_size * 9) {
+        return false;
+    }
+
+    // Everything optimal images are used for, including the filtered blit of direct presentation
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, MANDELBROT_COLOR_FORMAT, &format_properties);
+    VkFormatFeatureFlags required_features = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    if ((format_properties.linearTilingFeatures & required_features) != required_features) {
+        return false;
+    }
+
+    VkFormatProperties iteration_format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, MANDELBROT_ITERATION_FORMAT, &iteration_format_properties);
+    VkFormatFeatureFlags required_iteration_features = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    if ((iteration_format_properties.linearTilingFeatures & required_iteration_features) != required_iteration_features) {
+        return false;
+    }
+
+    // Linear images are allowed to be smaller than optimal ones, they have to be able to grow as large
+    VkImageFormatProperties image_format_properties;
+    if (vkGetPhysicalDeviceImageFormatProperties(physical_device, MANDELBROT_COLOR_FORMAT, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_LINEAR, MANDELBROT_COLOR_IMAGE_USAGE, 0, &image_format_properties) != VK_SUCCESS) {
+        return false;
+    }
+    VkImageFormatProperties iteration_image_format_properties;
+    if (vkGetPhysicalDeviceImageFormatProperties(physical_device, MANDELBROT_ITERATION_FORMAT, VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_LINEAR, MANDELBROT_ITERATION_IMAGE_USAGE, 0, &iteration_image_format_properties) != VK_SUCCESS) {
+        return false;
+    }
+    uint32_t max_extent = physical_device_properties.limits.maxImageDimension2D;
+    return image_format_properties.maxExtent.width >= max_extent && image_format_properties.maxExtent.height >= max_extent && iteration_image_format_properties.maxExtent.width >= max_extent && iteration_image_format_properties.maxExtent.height >= max_extent;
+}
+
+// One of the images of a frame, linear and mapped when color images are, see should_map_mandelbrot_color_images
+static result_t create_mandelbrot_frame_image(VkFormat format, VkImageUsageFlags usage, uint32_t width, uint32_t height, VkImage* out_image, VmaAllocation* out_allocation, VkImageView* out_image_view, void** out_data, size_t* out_row_pitch) {
+    // Concurrent sharing rather than ownership transfers, since a frame is sampled between every tile chunk a transfer pair per chunk would serialize the two queues
+    bool concurrent = mandelbrot_queue_family_indices[0] != mandelbrot_queue_family_indices[1];
 
+    VmaAllocationInfo allocation_info;
     if (vmaCreateImage(allocator, &(VkImageCreateInfo) {
         DEFAULT_VK_IMAGE,
         .imageType = VK_IMAGE_TYPE_2D,
-        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .format = format,
         .extent = { width, height, 1 },
-        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
-    }, &device_allocation_create_info, &mandelbrot_color_images[frame_index], &mandelbrot_color_image_allocations[frame_index], NULL) != VK_SUCCESS) {
+        .tiling = color_images_mapped ? VK_IMAGE_TILING_LINEAR : VK_IMAGE_TILING_OPTIMAL,
+        .usage = usage,
+        .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = concurrent ? 2 : 0,
+        .pQueueFamilyIndices = mandelbrot_queue_family_indices
+    }, color_images_mapped ? &mapped_device_write_allocation_create_info : &device_allocation_create_info, out_image, out_allocation, &allocation_info) != VK_SUCCESS) {
         return result_image_create_failure;
     }
 
+    if (color_images_mapped) {
+        VkSubresourceLayout layout;
+        vkGetImageSubresourceLayout(device, *out_image, &(VkImageSubresource) {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT
+        }, &layout);
+        *out_data = allocation_info.pMappedData + layout.offset;
+        *out_row_pitch = layout.rowPitch;
+    } else {
+        *out_data = NULL;
+        *out_row_pitch = 0;
+    }
+
     if (vkCreateImageView(device, &(VkImageViewCreateInfo) {
         DEFAULT_VK_IMAGE_VIEW,
-        .image = mandelbrot_color_images[frame_index],
+        .image = *out_image,
         .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = VK_FORMAT_R8G8B8A8_UNORM,
+        .format = format,
         .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT
-    }, NULL, &mandelbrot_color_image_views[frame_index]) != VK_SUCCESS) {
+    }, NULL, out_image_view) != VK_SUCCESS) {
         return result_image_view_create_failure;
     }
 
     return result_success;
 }
 
+// Sized for the frame at full resolution so that changing the resolution scale never reallocates
+static result_t create_mandelbrot_image(size_t frame_index, uint32_t framebuffer_width, uint32_t framebuffer_height, uint32_t margin) {
+    uint32_t width = get_mandelbrot_image_size_class(framebuffer_width + (2 * margin));
+    uint32_t height = get_mandelbrot_image_size_class(framebuffer_height + (2 * margin));
+    mandelbrot_dispatches[frame_index].image_width = width;
+    mandelbrot_dispatches[frame_index].image_height = height;
+
+    result_t result;
+    if ((result = create_mandelbrot_frame_image(MANDELBROT_COLOR_FORMAT, MANDELBROT_COLOR_IMAGE_USAGE, width, height, &mandelbrot_color_images[frame_index], &mandelbrot_color_image_allocations[frame_index], &mandelbrot_color_image_views[frame_index], &mandelbrot_color_image_data[frame_index], &mandelbrot_color_image_row_pitches[frame_index])) != result_success) {
+        return result;
+    }
+    if ((result = create_mandelbrot_frame_image(MANDELBROT_ITERATION_FORMAT, MANDELBROT_ITERATION_IMAGE_USAGE, width, height, &mandelbrot_iteration_images[frame_index], &mandelbrot_iteration_image_allocations[frame_index], &mandelbrot_iteration_image_views[frame_index], &mandelbrot_iteration_image_data[frame_index], &mandelbrot_iteration_image_row_pitches[frame_index])) != result_success) {
+        return result;
+    }
+
+    bool concurrent = mandelbrot_queue_family_indices[0] != mandelbrot_queue_family_indices[1];
+
+    if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+        DEFAULT_VK_STORAGE_BUFFER,
+        .size = get_mandelbrot_tile_capacity(frame_index) * sizeof(mandelbrot_tile_t),
+        .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = concurrent ? 2 : 0,
+        .pQueueFamilyIndices = mandelbrot_queue_family_indices
+    }, &shared_write_allocation_create_info, &mandelbrot_tile_buffers[frame_index], &mandelbrot_tile_buffer_allocations[frame_index], NULL) != VK_SUCCESS) {
+        return result_buffer_create_failure;
+    }
+
+    if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+        DEFAULT_VK_STORAGE_BUFFER,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .size = get_mandelbrot_tile_capacity(frame_index) * sizeof(uint32_t),
+        .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = concurrent ? 2 : 0,
+        .pQueueFamilyIndices = mandelbrot_queue_family_indices
+    }, &device_allocation_create_info, &mandelbrot_rate_buffers[frame_index], &mandelbrot_rate_buffer_allocations[frame_index], NULL) != VK_SUCCESS) {
+        return result_buffer_create_failure;
+    }
+
+    {
+        VmaAllocationInfo rate_staging_buffer_allocation_info;
+        if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+            DEFAULT_VK_STAGING_BUFFER,
+            .size = get_mandelbrot_tile_capacity(frame_index) * sizeof(uint32_t),
+            .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = concurrent ? 2 : 0,
+            .pQueueFamilyIndices = mandelbrot_queue_family_indices
+        }, &mapped_shared_write_allocation_create_info, &mandelbrot_rate_staging_buffers[frame_index], &mandelbrot_rate_staging_buffer_allocations[frame_index], &rate_staging_buffer_allocation_info) != VK_SUCCESS) {
+            return result_buffer_create_failure;
+        }
+        mandelbrot_rate_staging_data[frame_index] = rate_staging_buffer_allocation_info.pMappedData;
+    }
+
+    // Room for every tile of the frame, though a chunk only ever lists its own
+    if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+        DEFAULT_VK_STORAGE_BUFFER,
+        .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .size = sizeof(mandelbrot_work_t) + (get_mandelbrot_tile_capacity(frame_index) * sizeof(mandelbrot_tile_t)),
+        .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = concurrent ? 2 : 0,
+        .pQueueFamilyIndices = mandelbrot_queue_family_indices
+    }, &device_allocation_create_info, &mandelbrot_work_buffers[frame_index], &mandelbrot_work_buffer_allocations[frame_index], NULL) != VK_SUCCESS) {
+        return result_buffer_create_failure;
+    }
+
+    return result_success;
+}
+
+// Images are only replaced when they are too small for the frame at full resolution, or more than twice too large
+static bool does_mandelbrot_image_fit(size_t frame_index, uint32_t framebuffer_width, uint32_t framebuffer_height, uint32_t margin) {
+    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    uint32_t width = ceil_pow2(framebuffer_width + (2 * margin), 8);
+    uint32_t height = ceil_pow2(framebuffer_height + (2 * margin), 8);
+    return dispatch->image_width >= width && dispatch->image_height >= height && dispatch->image_width <= 2 * width && dispatch->image_height <= 2 * height;
+}
+
+// The gpu may still be computing into or sampling the image, it is handed over to be destroyed once it is done with the frame
+static void retire_mandelbrot_image(size_t index) {
+    retired_mandelbrot_images[index] = (retired_mandelbrot_image_t) {
+        .pending = true,
+        .compute_value = mandelbrot_frame_compute_values[index],
+        .render_value = mandelbrot_frame_render_values[index],
+        .color_image = mandelbrot_color_images[index],
+        .color_image_allocation = mandelbrot_color_image_allocations[index],
+        .color_image_view = mandelbrot_color_image_views[index],
+        .iteration_image = mandelbrot_iteration_images[index],
+        .iteration_image_allocation = mandelbrot_iteration_image_allocations[index],
+        .iteration_image_view = mandelbrot_iteration_image_views[index],
+        .buffers = { mandelbrot_tile_buffers[index], mandelbrot_rate_buffers[index], mandelbrot_rate_staging_buffers[index], mandelbrot_work_buffers[index] },
+        .buffer_allocations = { mandelbrot_tile_buffer_allocations[index], mandelbrot_rate_buffer_allocations[index], mandelbrot_rate_staging_buffer_allocations[index], mandelbrot_work_buffer_allocations[index] }
+    };
+}
+
+static void destroy_retired_mandelbrot_image(retired_mandelbrot_image_t* retired_image) {
+    for (size_t i = 0; i < 4; i++) {
+        vmaDestroyBuffer(allocator, retired_image->buffers[i], retired_image->buffer_allocations[i]);
+    }
+    vkDestroyImageView(device, retired_image->iteration_image_view, NULL);
+    vmaDestroyImage(allocator, retired_image->iteration_image, retired_image->iteration_image_allocation);
+    vkDestroyImageView(device, retired_image->color_image_view, NULL);
+    vmaDestroyImage(allocator, retired_image->color_image, retired_image->color_image_allocation);
+    retired_image->pending = false;
+}
+
+static void destroy_completed_retired_mandelbrot_images(void) {
+    uint64_t completed_compute_value;
+    vkGetSemaphoreCounterValue(device, mandelbrot_compute_semaphore, &completed_compute_value);
+    uint64_t completed_render_value;
+    vkGetSemaphoreCounterValue(device, render_timeline_semaphore, &completed_render_value);
+
+    for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
+        retired_mandelbrot_image_t* retired_image = &retired_mandelbrot_images[i];
+        if (retired_image->pending && completed_compute_value >= retired_image->compute_value && completed_render_value >= retired_image->render_value) {
+            destroy_retired_mandelbrot_image(retired_image);
+        }
+    }
+}
+
 static void destroy_mandelbrot_image(size_t index) {
+    vmaDestroyBuffer(allocator, mandelbrot_work_buffers[index], mandelbrot_work_buffer_allocations[index]);
+    vmaDestroyBuffer(allocator, mandelbrot_rate_staging_buffers[index], mandelbrot_rate_staging_buffer_allocations[index]);
+    vmaDestroyBuffer(allocator, mandelbrot_rate_buffers[index], mandelbrot_rate_buffer_allocations[index]);
+    vmaDestroyBuffer(allocator, mandelbrot_tile_buffers[index], mandelbrot_tile_buffer_allocations[index]);
+    vkDestroyImageView(device, mandelbrot_iteration_image_views[index], NULL);
+    vmaDestroyImage(allocator, mandelbrot_iteration_images[index], mandelbrot_iteration_image_allocations[index]);
     vkDestroyImageView(device, mandelbrot_color_image_views[index], NULL);
     vmaDestroyImage(allocator, mandelbrot_color_images[index], mandelbrot_color_image_allocations[index]);
 }
 
-result_t init_mandelbrot_management(VkQueue queue, VkCommandBuffer command_buffer, VkFence command_fence, uint32_t queue_family_index) {
+static uint32_t get_overscan_margin(void) {
+    // Wide enough to cover how far the view edges move until the frame is done
+    float edge_distance = glm_min(get_camera_edge_speed() * ((float) frame_latency / 1000000.0f), (float) MANDELBROT_OVERSCAN_MAX_MARGIN);
+    uint32_t target_margin = clamp_uint32(ceil_pow2((uint32_t) edge_distance, MANDELBROT_OVERSCAN_MARGIN_STEP), MANDELBROT_OVERSCAN_MIN_MARGIN, MANDELBROT_OVERSCAN_MAX_MARGIN);
+
+    // Grow right away but only shrink a step at a time so the images are not reallocated every frame
+    if (target_margin > overscan_margin) {
+        overscan_margin = target_margin;
+    } else if (target_margin + MANDELBROT_OVERSCAN_MARGIN_STEP < overscan_margin) {
+        overscan_margin -= MANDELBROT_OVERSCAN_MARGIN_STEP;
+    }
+
+    return overscan_margin;
+}
+
+// Pixel count and so compute time goes with the square of the scale, aim for the scale that would have hit the target
+static void update_resolution_scale(microseconds_t frame_compute_time, float frame_scale) {
+    if (frame_compute_time <= 0) {
+        return;
+    }
+
+    float target_scale = frame_scale * sqrtf((float) MANDELBROT_TARGET_FRAME_COMPUTE_TIME / (float) frame_compute_time);
+    resolution_scale = glm_clamp(glm_lerp(resolution_scale, target_scale, 0.5f), MANDELBROT_MIN_RESOLUTION_SCALE, 1.0f);
+}
+
+// Quantized so that images are not reallocated for every small change, idle frames are always at full resolution
+static float get_resolution_scale(bool still) {
+    if (still) {
+        return 1.0f;
+    }
+    return glm_clamp(roundf(resolution_scale / MANDELBROT_RESOLUTION_SCALE_STEP) * MANDELBROT_RESOLUTION_SCALE_STEP, MANDELBROT_MIN_RESOLUTION_SCALE, 1.0f);
+}
+
+// Maps the normalized coordinates of the whole image onto those of the framebuffer that sits in the middle of it
+static mat3s get_overscan_affine_map(size_t frame_index) {
+    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    float framebuffer_width = (float) dispatch->framebuffer_width;
+    float framebuffer_height = (float) dispatch->framebuffer_height;
+    float margin = (float) dispatch->margin;
+    return glms_scale2d_make((vec2s) {{ (framebuffer_width + (2.0f * margin)) / framebuffer_width, (framebuffer_height + (2.0f * margin)) / framebuffer_height }});
+}
+
+static float get_tile_priority(vec2s tile_center, vec2s image_center, bool has_cursor, vec2s cursor_position) {
+    if (has_cursor) {
+        float cursor_distance = glms_vec2_distance(tile_center, cursor_position);
+        if (cursor_distance < MANDELBROT_CURSOR_PRIORITY_RADIUS) {
+            return cursor_distance;
+        }
+    }
+    return MANDELBROT_CURSOR_PRIORITY_RADIUS + glms_vec2_distance(tile_center, image_center);
+}
+
+static int compare_tile_priorities(const void* a, const void* b) {
+    float a_priority = ((const prioritized_tile_t*) a)->priority;
+    float b_priority = ((const prioritized_tile_t*) b)->priority;
+    return (a_priority > b_priority) - (a_priority < b_priority);
+}
+
+// Tile positions are worked with in framebuffer pixels, which image pixels are scaled from
+static vec2s get_tile_center(const mandelbrot_dispatch_t* dispatch, uint32_t x, uint32_t y) {
+    vec2s pixel_scale = {{ (float) (dispatch->framebuffer_width + (2 * dispatch->margin)) / (float) (dispatch->width * 8), (float) (dispatch->framebuffer_height + (2 * dispatch->margin)) / (float) (dispatch->height * 8) }};
+    return glms_vec2_mul((vec2s) {{ ((float) x + 0.5f) * (float) MANDELBROT_TILE_SIZE, ((float) y + 0.5f) * (float) MANDELBROT_TILE_SIZE }}, pixel_scale);
+}
+
+static vec2s get_image_center(const mandelbrot_dispatch_t* dispatch) {
+    return (vec2s) {{ (float) (dispatch->framebuffer_width + (2 * dispatch->margin)) / 2.0f, (float) (dispatch->framebuffer_height + (2 * dispatch->margin)) / 2.0f }};
+}
+
+static bool get_image_cursor_position(const mandelbrot_dispatch_t* dispatch, vec2s* cursor_position) {
+    if (!get_cursor_position(cursor_position)) {
+        return false;
+    }
+    // The cursor is in framebuffer pixels which start after the margin
+    *cursor_position = glms_vec2_adds(*cursor_position, (float) dispatch->margin);
+    return true;
+}
+
+// Orders the tiles of a frame so that the region around the cursor comes first and the rest goes from the center outwards
+static result_t write_mandelbrot_tiles(size_t frame_index) {
+    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    uint32_t num_tiles_x = div_ceil_uint32(dispatch->width, MANDELBROT_TILE_GROUPS);
+    uint32_t num_tiles_y = div_ceil_uint32(dispatch->height, MANDELBROT_TILE_GROUPS);
+    size_t num_tiles = num_tiles_x * num_tiles_y;
+
+    vec2s image_center = get_image_center(dispatch);
+
+    vec2s cursor_position = {{ 0.0f, 0.0f }};
+    bool has_cursor = get_image_cursor_position(dispatch, &cursor_position);
+
+    prioritized_tile_t prioritized_tiles[num_tiles];
+    for (uint32_t y = 0; y < num_tiles_y; y++) {
+        for (uint32_t x = 0; x < num_tiles_x; x++) {
+            vec2s tile_center = get_tile_center(dispatch, x, y);
+            prioritized_tiles[(y * num_tiles_x) + x] = (prioritized_tile_t) {
+                .tile = { x, y },
+                .priority = get_tile_priority(tile_center, image_center, has_cursor, cursor_position)
+            };
+        }
+    }
+
+    qsort(prioritized_tiles, num_tiles, sizeof(prioritized_tile_t), compare_tile_priorities);
+
+    // Kept on the host too for the cpu workers
+    if (num_tiles > back_frame_tile_capacity) {
+        back_frame_tiles = realloc(back_frame_tiles, num_tiles * sizeof(mandelbrot_tile_t));
+        back_frame_tile_capacity = (uint32_t) num_tiles;
+    }
+    for (size_t i = 0; i < num_tiles; i++) {
+        back_frame_tiles[i] = prioritized_tiles[i].tile;
+    }
+
+    return write_to_buffer(mandelbrot_tile_buffer_allocations[frame_index], num_tiles * sizeof(mandelbrot_tile_t), back_frame_tiles);
+}
+
+static float get_halton(uint32_t index, uint32_t base) {
+    float fraction = 1.0f;
+    float value = 0.0f;
+    while (index > 0) {
+        fraction /= (float) base;
+        value += fraction * (float) (index % base);
+        index /= base;
+    }
+    return value;
+}
+
+// Sub pixel offset of a sample, the first sample of a frame is not jittered so that it lines up with the previous frame
+static vec2s get_sample_jitter(uint32_t sample_index) {
+    if (sample_index == 0) {
+        return (vec2s) {{ 0.0f, 0.0f }};
+    }
+    return (vec2s) {{ get_halton(sample_index, 2) - 0.5f, get_halton(sample_index, 3) - 0.5f }};
+}
+
+// Samples per pixel side of each tile, when foveated the density falls off away from the cursor or, without one, the center
+// Only staged here, the begin command buffer of the frame copies them over. Comes after write_mandelbrot_tiles since the entries also hold where tiles are in the list
+static void write_mandelbrot_rates(size_t frame_index, bool foveated) {
+    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    uint32_t num_tiles_x = div_ceil_uint32(dispatch->width, MANDELBROT_TILE_GROUPS);
+    uint32_t num_tiles_y = div_ceil_uint32(dispatch->height, MANDELBROT_TILE_GROUPS);
+    size_t num_tiles = num_tiles_x * num_tiles_y;
+
+    vec2s focus_position;
+    if (!get_image_cursor_position(dispatch, &focus_position)) {
+        focus_position = get_image_center(dispatch);
+    }
+
+    uint32_t* rates = mandelbrot_rate_staging_data[frame_index];
+    for (uint32_t y = 0; y < num_tiles_y; y++) {
+        for (uint32_t x = 0; x < num_tiles_x; x++) {
+            uint32_t rate = 1;
+            if (foveated) {
+                float focus_distance = glms_vec2_distance(get_tile_center(dispatch, x, y), focus_position);
+                if (focus_distance >= 2.0f * MANDELBROT_FOVEA_RADIUS) {
+                    rate = 4;
+                } else if (focus_distance >= MANDELBROT_FOVEA_RADIUS) {
+                    rate = 2;
+                }
+            }
+            rates[(y * num_tiles_x) + x] = rate;
+        }
+    }
+
+    for (uint32_t i = 0; i < num_tiles; i++) {
+        rates[(back_frame_tiles[i].y * num_tiles_x) + back_frame_tiles[i].x] |= i << MANDELBROT_RATE_BITS;
+    }
+}
+
+// The frame's entry of the parameter ring is free since the previous chunk of the frame has to be done before the next one is submitted
+static void write_mandelbrot_compute_parameters(size_t frame_index, uint32_t tile_offset, uint32_t num_tiles, uint32_t sample_index, uint32_t num_pages) {
+    mandelbrot_compute_parameters_t* parameters = mandelbrot_parameter_data + (frame_index * MANDELBROT_PARAMETER_STRIDE);
+    parameters->classify_command = (VkDispatchIndirectCommand) { num_tiles, 1, 1 };
+    parameters->tile_offset = tile_offset;
+    for (size_t i = 0; i < 3; i++) {
+        parameters->affine_map[i].col = mandelbrot_compute_affine_maps[frame_index].col[i];
+    }
+    parameters->generation = generation;
+    parameters->sample_index = sample_index;
+    parameters->jitter = get_sample_jitter(sample_index);
+    parameters->image_width = mandelbrot_dispatches[frame_index].width * 8;
+    parameters->image_height = mandelbrot_dispatches[frame_index].height * 8;
+    parameters->page_level = frame_page_levels[frame_index];
+    parameters->page_command = (VkDispatchIndirectCommand) { num_pages * MANDELBROT_TILE_GROUPS, MANDELBROT_TILE_GROUPS, 1 };
+}
+
+static int32_t get_frame_page_level(size_t frame_index) {
+    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    return get_mandelbrot_page_level(&mandelbrot_compute_affine_maps[frame_index], dispatch->framebuffer_width + (2 * dispatch->margin), dispatch->framebuffer_height + (2 * dispatch->margin));
+}
+
+// Has to be redone whenever the frame's image and so its descriptor sets change
+static result_t record_mandelbrot_command_buffers(size_t frame_index) {
+    VkCommandBuffer begin_command_buffer = mandelbrot_begin_command_buffers[frame_index];
+    if (vkResetCommandBuffer(begin_command_buffer, 0) != VK_SUCCESS) {
+        return result_command_buffer_reset_failure;
+    }
+
+    if (vkBeginCommandBuffer(begin_command_buffer, &(VkCommandBufferBeginInfo) {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+    }) != VK_SUCCESS) {
+        return result_command_buffer_begin_failure;
+    }
+
+    record_mandelbrot_compute_pipeline_begin(begin_command_buffer, frame_index);
+
+    if (vkEndCommandBuffer(begin_command_buffer) != VK_SUCCESS) {
+        return result_command_buffer_end_failure;
+    }
+
+    VkCommandBuffer chunk_command_buffer = mandelbrot_chunk_command_buffers[frame_index];
+    if (vkResetCommandBuffer(chunk_command_buffer, 0) != VK_SUCCESS) {
+        return result_command_buffer_reset_failure;
+    }
+
+    if (vkBeginCommandBuffer(chunk_command_buffer, &(VkCommandBufferBeginInfo) {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+    }) != VK_SUCCESS) {
+        return result_command_buffer_begin_failure;
+    }
+
+    vkCmdResetQueryPool(chunk_command_buffer, mandelbrot_timestamp_query_pool, 2 * (uint32_t) frame_index, 2);
+    vkCmdWriteTimestamp(chunk_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mandelbrot_timestamp_query_pool, 2 * (uint32_t) frame_index);
+
+    record_mandelbrot_compute_pipeline(chunk_command_buffer, frame_index);
+
+    vkCmdWriteTimestamp(chunk_command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mandelbrot_timestamp_query_pool, 2 * (uint32_t) frame_index + 1);
+
+    if (vkEndCommandBuffer(chunk_command_buffer) != VK_SUCCESS) {
+        return result_command_buffer_end_failure;
+    }
+
+    return result_success;
+}
+
+result_t init_mandelbrot_management(VkPhysicalDevice physical_device, VkQueue queue, VkCommandBuffer command_buffer, VkFence command_fence, uint32_t queue_family_index, VkQueue compute_queue, uint32_t compute_queue_family_index) {
     result_t result;
 
     if (vkCreateQueryPool(device, &(VkQueryPoolCreateInfo) {
@@ -72,33 +655,92 @@ result_t init_mandelbrot_management(VkQueue queue, VkCommandBuffer command_buffe
         return result_query_pool_create_failure;
     }
 
-    vkGetDeviceQueue(device, queue_family_index, 0, &mandelbrot_queue);
+    color_images_mapped = should_map_mandelbrot_color_images(physical_device);
+
+    hybrid = MANDELBROT_HYBRID && color_images_mapped;
+    if (hybrid && (result = init_mandelbrot_cpu()) != result_success) {
+        return result;
+    }
+
+    mandelbrot_queue = compute_queue;
+    mandelbrot_queue_family_indices[0] = queue_family_index;
+    mandelbrot_queue_family_indices[1] = compute_queue_family_index;
 
-    memset(mandelbrot_frame_index_to_render_frame_index, 0, sizeof(mandelbrot_frame_index_to_render_frame_index));
+    memset(mandelbrot_frame_compute_values, 0, sizeof(mandelbrot_frame_compute_values));
+    memset(mandelbrot_frame_render_values, 0, sizeof(mandelbrot_frame_render_values));
 
-    for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
-        if (vkCreateFence(device, &(VkFenceCreateInfo) {
-            .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-            .flags = VK_FENCE_CREATE_SIGNALED_BIT
-        }, NULL, &mandelbrot_fences[i]) != VK_SUCCESS) {
-            return result_synchronization_primitive_create_failure;
+    if ((result = create_timeline_semaphore(&mandelbrot_compute_semaphore)) != result_success) {
+        return result;
+    }
+
+    if ((result = init_mandelbrot_page_cache(mandelbrot_queue_family_indices)) != result_success) {
+        return result;
+    }
+
+    {
+        bool concurrent = mandelbrot_queue_family_indices[0] != mandelbrot_queue_family_indices[1];
+        if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+            DEFAULT_VK_STORAGE_BUFFER,
+            .size = sizeof(generation),
+            .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = concurrent ? 2 : 0,
+            .pQueueFamilyIndices = mandelbrot_queue_family_indices
+        }, &shared_write_allocation_create_info, &mandelbrot_generation_buffer, &mandelbrot_generation_buffer_allocation, NULL) != VK_SUCCESS) {
+            return result_buffer_create_failure;
         }
     }
 
+    if ((result = write_to_buffer(mandelbrot_generation_buffer_allocation, sizeof(generation), &generation)) != result_success) {
+        return result;
+    }
+
+    {
+        bool concurrent = mandelbrot_queue_family_indices[0] != mandelbrot_queue_family_indices[1];
+        VmaAllocationInfo parameter_buffer_allocation_info;
+        if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+            DEFAULT_VK_UNIFORM_BUFFER,
+            .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            .size = NUM_MANDELBROT_FRAMES_IN_FLIGHT * MANDELBROT_PARAMETER_STRIDE,
+            .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = concurrent ? 2 : 0,
+            .pQueueFamilyIndices = mandelbrot_queue_family_indices
+        }, &mapped_shared_write_allocation_create_info, &mandelbrot_parameter_buffer, &mandelbrot_parameter_buffer_allocation, &parameter_buffer_allocation_info) != VK_SUCCESS) {
+            return result_buffer_create_failure;
+        }
+        mandelbrot_parameter_data = parameter_buffer_allocation_info.pMappedData;
+    }
+
     int width;
     int height;
-    glfwGetFramebufferSize(window, &width, &height);
+    get_camera_framebuffer_size(&width, &height);
 
     uint32_t ceil_width = ceil_pow2((uint32_t) width, 8);
     uint32_t ceil_height = ceil_pow2((uint32_t) height, 8);
 
     for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
-        if ((result = create_mandelbrot_image(i, ceil_width, ceil_height)) != result_success) {
+        if ((result = create_mandelbrot_image(i, ceil_width, ceil_height, overscan_margin)) != result_success) {
             return result;
         }
+        set_mandelbrot_dispatch(i, ceil_width, ceil_height, overscan_margin, 1.0f);
+        update_mandelbrot_compute_pipeline(i);
+
+        frame_views[i] = get_camera_view();
+        frame_num_samples[i] = 0;
+        mandelbrot_compute_affine_maps[i] = glms_mat3_mul(get_camera_view_affine_map(&frame_views[i]), get_overscan_affine_map(i));
+        frame_page_levels[i] = get_frame_page_level(i);
     }
 
-    update_mandelbrot_compute_pipeline(front_frame_index);
+    if ((result = write_mandelbrot_tiles(front_frame_index)) != result_success) {
+        return result;
+    }
+    frame_foveated[front_frame_index] = false;
+    write_mandelbrot_rates(front_frame_index, false);
+    {
+        // Whatever the page file has of the starting view is uploaded rather than computed
+        uint32_t num_page_computes;
+        uint32_t num_page_uploads = update_mandelbrot_pages(frame_page_levels[front_frame_index], &mandelbrot_compute_affine_maps[front_frame_index], 0, &num_page_computes);
+        write_mandelbrot_compute_parameters(front_frame_index, 0, get_num_mandelbrot_tiles(front_frame_index), 0, num_page_uploads);
+    }
 
     if (vkBeginCommandBuffer(command_buffer, &(VkCommandBufferBeginInfo) {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -111,19 +753,16 @@ result_t init_mandelbrot_management(VkQueue queue, VkCommandBuffer command_buffe
     for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
         vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mandelbrot_timestamp_query_pool, 2 * (uint32_t) i);
         vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mandelbrot_timestamp_query_pool, 2 * (uint32_t) i + 1);
-        mandelbrot_compute_affine_maps[i] = get_affine_map();
     }
 
-    record_mandelbrot_compute_pipeline_init_to_compute_transition(command_buffer, front_frame_index);
-    record_mandelbrot_compute_pipeline(command_buffer, front_frame_index, &mandelbrot_compute_affine_maps[front_frame_index]);
+    record_mandelbrot_page_cache_init(command_buffer);
+
+    // The first front frame is computed in one go so there is always something to show
+    record_mandelbrot_compute_pipeline_begin(command_buffer, front_frame_index);
+    record_mandelbrot_compute_pipeline(command_buffer, front_frame_index);
+    record_mandelbrot_compute_pipeline_compute_to_fragment_transition(command_buffer, front_frame_index);
+    frame_num_samples[front_frame_index] = 1;
 
-    for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
-        if (i == front_frame_index) {
-            continue;
-        }
-        record_mandelbrot_compute_pipeline_init_to_fragment_transition(command_buffer, i);
-    }
-    
     if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
         return result_command_buffer_end_failure;
     }
@@ -138,7 +777,7 @@ result_t init_mandelbrot_management(VkQueue queue, VkCommandBuffer command_buffe
     if (vkCreateCommandPool(device, &(VkCommandPoolCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-        .queueFamilyIndex = queue_family_index
+        .queueFamilyIndex = compute_queue_family_index
     }, NULL, &mandelbrot_command_pool) != VK_SUCCESS) {
         return result_command_pool_create_failure;
     }
@@ -147,93 +786,478 @@ result_t init_mandelbrot_management(VkQueue queue, VkCommandBuffer command_buffe
         DEFAULT_VK_COMMAND_BUFFER,
         .commandPool = mandelbrot_command_pool,
         .commandBufferCount = NUM_MANDELBROT_FRAMES_IN_FLIGHT
-    }, mandelbrot_command_buffers) != VK_SUCCESS) {
+    }, mandelbrot_begin_command_buffers) != VK_SUCCESS) {
         return result_command_buffers_allocate_failure;
     }
 
+    if (vkAllocateCommandBuffers(device, &(VkCommandBufferAllocateInfo) {
+        DEFAULT_VK_COMMAND_BUFFER,
+        .commandPool = mandelbrot_command_pool,
+        .commandBufferCount = NUM_MANDELBROT_FRAMES_IN_FLIGHT
+    }, mandelbrot_chunk_command_buffers) != VK_SUCCESS) {
+        return result_command_buffers_allocate_failure;
+    }
+
+    for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
+        if ((result = record_mandelbrot_command_buffers(i)) != result_success) {
+            return result;
+        }
+    }
+
     return result_success;
 }
 
-result_t manage_mandelbrot_frames(const VkPhysicalDeviceProperties* physical_device_properties, microseconds_t* out_mandelbrot_frame_compute_time) {
+static result_t begin_mandelbrot_frame(size_t frame_index, uint32_t framebuffer_width, uint32_t framebuffer_height, uint32_t margin, float scale, bool foveated) {
     result_t result;
 
-    *out_mandelbrot_frame_compute_time = 0;
+    // If the framebuffer size or margin no longer fit the image then we create a new mandelbrot color image, make sure to update both pipelines and rerecord what they were bound in
+    if (!does_mandelbrot_image_fit(frame_index, framebuffer_width, framebuffer_height, margin)) {
+        retire_mandelbrot_image(frame_index);
+        if ((result = create_mandelbrot_image(frame_index, framebuffer_width, framebuffer_height, margin)) != result_success) {
+            return result;
+        }
 
-    {
-        size_t back_frame_index = (front_frame_index + 1) % NUM_MANDELBROT_FRAMES_IN_FLIGHT;
-        VkFence command_fence = mandelbrot_fences[back_frame_index];
-        if (vkGetFenceStatus(device, command_fence) != VK_SUCCESS) {
-            return result_success;
+        update_mandelbrot_compute_pipeline(frame_index);
+        update_mandelbrot_render_pipeline(frame_index);
+        if ((result = record_mandelbrot_command_buffers(frame_index)) != result_success) {
+            return result;
         }
+    }
+
+    set_mandelbrot_dispatch(frame_index, framebuffer_width, framebuffer_height, margin, scale);
+
+    frame_views[frame_index] = get_predicted_camera_view(MANDELBROT_CAMERA_PREDICTION, frame_latency);
+    mandelbrot_compute_affine_maps[frame_index] = glms_mat3_mul(get_camera_view_affine_map(&frame_views[frame_index]), get_overscan_affine_map(frame_index));
 
-        update_mandelbrot_render_pipeline(back_frame_index);
+    frame_page_levels[frame_index] = get_frame_page_level(frame_index);
+
+    if ((result = write_mandelbrot_tiles(frame_index)) != result_success) {
+        return result;
     }
-    front_frame_index = (front_frame_index + 1) % NUM_MANDELBROT_FRAMES_IN_FLIGHT;
-    size_t back_frame_index = (front_frame_index + 1) % NUM_MANDELBROT_FRAMES_IN_FLIGHT;
 
-    uint64_t timestamps[2];
-    vkGetQueryPoolResults(device, mandelbrot_timestamp_query_pool, 2 * (uint32_t) back_frame_index, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    frame_foveated[frame_index] = foveated;
+    write_mandelbrot_rates(frame_index, foveated);
 
-    *out_mandelbrot_frame_compute_time = get_query_microseconds(timestamps[0], timestamps[1], physical_device_properties->limits.timestampPeriod);
-    
-    // Make sure the gpu is not rendering using the mandelbrot back frame
-    {
-        VkFence render_fence = in_flight_fences[mandelbrot_frame_index_to_render_frame_index[back_frame_index]];
-        vkWaitForFences(device, 1, &render_fence, VK_TRUE, UINT64_MAX);
+    back_frame_in_progress = true;
+    back_frame_sample_index = 0;
+    num_back_frame_submitted_tiles = 0;
+    num_back_frame_cpu_tiles = 0;
+    back_frame_compute_time = 0;
+    back_frame_cpu_compute_time = 0;
+    back_frame_begin_time = get_current_microseconds();
+
+    return result_success;
+}
+
+// Adds one more sample to every pixel of the front frame, nothing is cleared since the frame stays on screen the whole time
+static result_t begin_mandelbrot_accumulation_pass(size_t frame_index) {
+    result_t result;
+
+    if ((result = write_mandelbrot_tiles(frame_index)) != result_success) {
+        return result;
     }
 
-    VkCommandBuffer command_buffer = mandelbrot_command_buffers[back_frame_index];
-    if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
-        return result_command_buffer_reset_failure;
+    back_frame_in_progress = true;
+    back_frame_sample_index = frame_num_samples[frame_index];
+    num_back_frame_submitted_tiles = 0;
+    num_back_frame_cpu_tiles = 0;
+    back_frame_compute_time = 0;
+    back_frame_cpu_compute_time = 0;
+
+    return result_success;
+}
+
+// The frame that has gone the longest without being rendered is the least likely to still be read by the gpu
+static size_t get_next_back_frame_index(void) {
+    size_t next_back_frame_index = (front_frame_index + 1) % NUM_MANDELBROT_FRAMES_IN_FLIGHT;
+    for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
+        if (i != front_frame_index && mandelbrot_frame_render_values[i] < mandelbrot_frame_render_values[next_back_frame_index]) {
+            next_back_frame_index = i;
+        }
     }
+    return next_back_frame_index;
+}
 
-    if (vkBeginCommandBuffer(command_buffer, &(VkCommandBufferBeginInfo) {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
-    }) != VK_SUCCESS) {
-        return result_command_buffer_begin_failure;
+// A frame is stale once the view it would be displayed at, going by the camera prediction, is no longer covered by it or is zoomed in too far on it
+static bool is_back_frame_stale(void) {
+    microseconds_t remaining_latency = back_frame_begin_time + frame_latency - get_current_microseconds();
+    if (remaining_latency < 0) {
+        remaining_latency = 0;
+    }
+    camera_view_t view = get_predicted_camera_view(MANDELBROT_CAMERA_PREDICTION, remaining_latency);
+    mat3s tween_affine_map = get_mandelbrot_frame_tween_affine_map(back_frame_index, &view);
+
+    if (sqrtf(fabsf(glms_mat3_det(tween_affine_map))) < 1.0f / MANDELBROT_STALE_ZOOM_FACTOR) {
+        return true;
+    }
+
+    for (size_t i = 0; i < 4; i++) {
+        vec3s corner = glms_mat3_mulv(tween_affine_map, (vec3s) {{ (i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, 1.0f }});
+        if (fabsf(corner.x) > 1.0f || fabsf(corner.y) > 1.0f) {
+            return true;
+        }
     }
 
-    vkCmdResetQueryPool(command_buffer, mandelbrot_timestamp_query_pool, 2 * (uint32_t) back_frame_index, 2);
-    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, mandelbrot_timestamp_query_pool, 2 * (uint32_t) back_frame_index);
+    return false;
+}
 
+// Still when the current view is within a fraction of a pixel of the one the frame was computed for
+static bool is_view_still(size_t frame_index) {
     int width;
     int height;
-    glfwGetFramebufferSize(window, &width, &height);
+    get_camera_framebuffer_size(&width, &height);
 
-    uint32_t ceil_width = ceil_pow2((uint32_t) width, 8);
-    uint32_t ceil_height = ceil_pow2((uint32_t) height, 8);
+    const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[frame_index];
+    if (dispatch->framebuffer_width != ceil_pow2((uint32_t) width, 8) || dispatch->framebuffer_height != ceil_pow2((uint32_t) height, 8)) {
+        return false;
+    }
+
+    camera_view_t view = get_camera_view();
+    mat3s tween_affine_map = get_camera_tween_affine_map(&frame_views[frame_index], &view);
+
+    for (size_t i = 0; i < 4; i++) {
+        vec3s corner = {{ (i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, 1.0f }};
+        vec3s tween_corner = glms_mat3_mulv(tween_affine_map, corner);
+        if (fabsf(tween_corner.x - corner.x) * (float) width > 2.0f * MANDELBROT_STILL_TOLERANCE || fabsf(tween_corner.y - corner.y) * (float) height > 2.0f * MANDELBROT_STILL_TOLERANCE) {
+            return false;
+        }
+    }
 
+    return true;
+}
+
+mat3s get_mandelbrot_frame_tween_affine_map(size_t frame_index, const camera_view_t* view) {
+    return glms_mat3_mul(glms_mat3_inv(get_overscan_affine_map(frame_index)), get_camera_tween_affine_map(&frame_views[frame_index], view));
+}
+
+// Such a frame covers the framebuffer pixel for pixel, so it can be copied to the screen as is instead of being reprojected
+bool is_mandelbrot_frame_presentable(size_t frame_index) {
+    return mandelbrot_dispatches[frame_index].scale == 1.0f && !frame_foveated[frame_index] && is_view_still(frame_index);
+}
+
+// From the back of the tile list, the gpu works its way from the front
+// Every rendered frame from now on leaves the tiles out, the workers start on them once those before are done, see start_back_frame_cpu_tiles
+static void reserve_back_frame_cpu_tiles(uint32_t num_tiles) {
+    num_back_frame_cpu_tiles += num_tiles;
+    num_cpu_batch_tiles = num_tiles;
+    cpu_batch_started = false;
+    cpu_batch_render_value = mandelbrot_frame_render_values[back_frame_index];
+}
+
+static mandelbrot_cpu_frame_t get_back_frame_cpu_frame(void) {
     const mandelbrot_dispatch_t* dispatch = &mandelbrot_dispatches[back_frame_index];
-    // If we have changed framebuffer size then we create a new mandelbrot color image, make sure to update render pipeline and get it ready for compute
-    if (dispatch->width * 8 != ceil_width || dispatch->height * 8 != ceil_height) {
-        destroy_mandelbrot_image(back_frame_index);
-        if ((result = create_mandelbrot_image(back_frame_index, ceil_width, ceil_height)) != result_success) {
+    mat3s overscan_affine_map = get_overscan_affine_map(back_frame_index);
+
+    mandelbrot_cpu_frame_t cpu_frame = {
+        .pixels = mandelbrot_color_image_data[back_frame_index],
+        .row_pitch = mandelbrot_color_image_row_pitches[back_frame_index],
+        .iterations = mandelbrot_iteration_image_data[back_frame_index],
+        .iteration_row_pitch = mandelbrot_iteration_image_row_pitches[back_frame_index],
+        .image_width = dispatch->width * 8,
+        .image_height = dispatch->height * 8,
+        .sample_index = back_frame_sample_index,
+        .jitter = get_sample_jitter(back_frame_sample_index),
+        .rates = mandelbrot_rate_staging_data[back_frame_index]
+    };
+
+    // Built from the view in double precision rather than from the float map the gpu gets, the overscan only scales
+    get_camera_view_double_affine_map(&frame_views[back_frame_index], cpu_frame.affine_map);
+    for (size_t i = 0; i < 2; i++) {
+        cpu_frame.affine_map[0][i] *= (double) overscan_affine_map.col[0].x;
+        cpu_frame.affine_map[1][i] *= (double) overscan_affine_map.col[1].y;
+    }
+
+    return cpu_frame;
+}
+
+static void start_back_frame_cpu_tiles(void) {
+    mandelbrot_cpu_frame_t cpu_frame = get_back_frame_cpu_frame();
+
+    cpu_batch_started = true;
+    submit_mandelbrot_cpu_tiles(&cpu_frame, num_cpu_batch_tiles, &back_frame_tiles[get_num_mandelbrot_tiles(back_frame_index) - num_back_frame_cpu_tiles]);
+}
+
+void get_mandelbrot_pending_cpu_tiles(uint32_t* out_begin, uint32_t* out_end) {
+    *out_begin = 0;
+    *out_end = 0;
+    // A cancelled batch is left out too, the workers may still be on a tile of it
+    if (num_cpu_batch_tiles > 0) {
+        *out_begin = get_num_mandelbrot_tiles(back_frame_index) - num_back_frame_cpu_tiles;
+        *out_end = *out_begin + num_cpu_batch_tiles;
+    }
+}
+
+static result_t cancel_back_frame(void) {
+    back_frame_in_progress = false;
+    chunk_cancelled = num_chunk_tiles > 0;
+
+    if (num_cpu_batch_tiles > 0 && cpu_batch_started) {
+        cancel_mandelbrot_cpu_tiles();
+        cpu_batch_cancelled = true;
+    } else {
+        num_cpu_batch_tiles = 0;
+    }
+
+    generation++;
+    return write_to_buffer(mandelbrot_generation_buffer_allocation, sizeof(generation), &generation);
+}
+
+result_t manage_mandelbrot_frames(const VkPhysicalDeviceProperties* physical_device_properties, microseconds_t* out_mandelbrot_frame_compute_time) {
+    result_t result;
+
+    *out_mandelbrot_frame_compute_time = 0;
+    idle = false;
+
+    destroy_completed_retired_mandelbrot_images();
+
+    // Checked before waiting on the chunk in flight so that it can stop early
+    if (back_frame_in_progress && back_frame_index != front_frame_index && is_back_frame_stale()) {
+        if ((result = cancel_back_frame()) != result_success) {
             return result;
         }
+    }
 
-        record_mandelbrot_compute_pipeline_init_to_compute_transition(command_buffer, back_frame_index);
-    } else {
-        record_mandelbrot_compute_pipeline_fragment_to_compute_transition(command_buffer, back_frame_index);
+    // Accumulation passes are simply not continued, the chunk in flight only refines the frame that is displayed
+    if (back_frame_in_progress && back_frame_index == front_frame_index && !is_view_still(front_frame_index)) {
+        back_frame_in_progress = false;
     }
 
-    mandelbrot_compute_affine_maps[back_frame_index] = get_affine_map();
+    // Not held up by the chunk in flight, the workers have nothing to do with it
+    if (num_cpu_batch_tiles > 0 && !cpu_batch_started) {
+        uint64_t completed_render_value;
+        vkGetSemaphoreCounterValue(device, render_timeline_semaphore, &completed_render_value);
+        if (completed_render_value >= cpu_batch_render_value) {
+            start_back_frame_cpu_tiles();
+        }
+    }
 
-    update_mandelbrot_compute_pipeline(back_frame_index);
-    record_mandelbrot_compute_pipeline(command_buffer, back_frame_index, &mandelbrot_compute_affine_maps[back_frame_index]);
-    
-    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, mandelbrot_timestamp_query_pool, 2 * (uint32_t) back_frame_index + 1);
+    {
+        uint64_t completed_compute_value;
+        vkGetSemaphoreCounterValue(device, mandelbrot_compute_semaphore, &completed_compute_value);
+        if (completed_compute_value < mandelbrot_frame_compute_values[back_frame_index] || completed_compute_value < page_chunk_compute_value) {
+            return result_success;
+        }
+    }
 
-    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-        return result_command_buffer_end_failure;
+    // The timing of a cancelled chunk says nothing about tile cost
+    if (num_chunk_tiles > 0 && chunk_cancelled) {
+        num_chunk_tiles = 0;
+        chunk_cancelled = false;
+    }
+
+    if (num_chunk_pages > 0) {
+        uint64_t timestamps[2];
+        vkGetQueryPoolResults(device, mandelbrot_timestamp_query_pool, 2 * (uint32_t) back_frame_index, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+        microseconds_t chunk_compute_time = get_query_microseconds(timestamps[0], timestamps[1], physical_device_properties->limits.timestampPeriod);
+        page_compute_time = glm_lerp(page_compute_time, (float) chunk_compute_time / (float) num_chunk_pages, 0.25f);
+        num_chunk_pages = 0;
+
+        complete_mandelbrot_page_requests();
+    }
+
+    if (num_chunk_tiles > 0) {
+        uint64_t timestamps[2];
+        vkGetQueryPoolResults(device, mandelbrot_timestamp_query_pool, 2 * (uint32_t) back_frame_index, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+        microseconds_t chunk_compute_time = get_query_microseconds(timestamps[0], timestamps[1], physical_device_properties->limits.timestampPeriod);
+        back_frame_compute_time += chunk_compute_time;
+
+        // Smoothed since tile cost varies a lot across the image
+        tile_compute_time = glm_lerp(tile_compute_time, (float) chunk_compute_time / (float) num_chunk_tiles, 0.25f);
+        num_chunk_tiles = 0;
+    }
+
+    // The workers time their tiles themselves so noticing they are done a frame late does not matter
+    // Their writes are all in by the next submission, so rendered frames take the tiles back in from then on
+    if (num_cpu_batch_tiles > 0 && cpu_batch_started && are_mandelbrot_cpu_tiles_done()) {
+        if (!cpu_batch_cancelled) {
+            microseconds_t batch_compute_time = get_mandelbrot_cpu_tiles_time();
+            back_frame_cpu_compute_time += batch_compute_time;
+            cpu_tile_compute_time = glm_lerp(cpu_tile_compute_time, (float) batch_compute_time / (float) num_cpu_batch_tiles, 0.25f);
+        }
+        num_cpu_batch_tiles = 0;
+        cpu_batch_cancelled = false;
+        cpu_batch_started = false;
+    }
+
+    // The newest completed frame is always the one displayed, once both the gpu and the workers are done with their tiles of it
+    if (back_frame_in_progress && num_back_frame_submitted_tiles + num_back_frame_cpu_tiles == get_num_mandelbrot_tiles(back_frame_index)) {
+        if (num_cpu_batch_tiles > 0) {
+            return result_success;
+        }
+
+        back_frame_in_progress = false;
+        // The two sides work at the same time, whichever took longer is how long the frame took
+        microseconds_t frame_compute_time = back_frame_compute_time > back_frame_cpu_compute_time ? back_frame_compute_time : back_frame_cpu_compute_time;
+        *out_mandelbrot_frame_compute_time = frame_compute_time;
+
+        if (back_frame_index == front_frame_index) {
+            frame_num_samples[front_frame_index]++;
+        } else {
+            // The first tile is always the gpu's as long as it computed any, the compute command buffer makes its writes visible to the host
+            if (color_images_mapped && !gpu_kernel_checked && num_back_frame_submitted_tiles > 0) {
+                mandelbrot_cpu_frame_t cpu_frame = get_back_frame_cpu_frame();
+                if (!matches_mandelbrot_cpu_reference(&cpu_frame, &back_frame_tiles[0])) {
+                    printf("GPU engine: mandelbrot.comp disagrees with the reference\n");
+                }
+                gpu_kernel_checked = true;
+            }
+
+            front_frame_index = back_frame_index;
+            frame_num_samples[front_frame_index] = 1;
+
+            update_resolution_scale(frame_compute_time, mandelbrot_dispatches[front_frame_index].scale);
+
+            microseconds_t back_frame_latency = get_current_microseconds() - back_frame_begin_time;
+            frame_latency = (frame_latency + back_frame_latency) / 2;
+        }
+    }
+
+    // The render timeline value the chunk waits for, 0 when no rendered frame reads what it writes
+    uint64_t render_wait_value = 0;
+
+    uint32_t ceil_width = 0;
+    uint32_t ceil_height = 0;
+    uint32_t margin = 0;
+    float scale = 1.0f;
+    bool accumulate = false;
+    uint32_t num_pages = 0;
+    bool still = is_view_still(front_frame_index);
+    // A frame that was computed at a lower resolution or foveated is recomputed at full resolution before accumulating on it
+    if (!back_frame_in_progress && still && mandelbrot_dispatches[front_frame_index].scale == 1.0f && !frame_foveated[front_frame_index]) {
+        // The missing pages of the view are filled first so that coming back to it later costs nothing
+        uint32_t num_budget_pages = clamp_uint32((uint32_t) ((float) MANDELBROT_COMPUTE_BUDGET / glm_max(page_compute_time, 1.0f)), 1, MANDELBROT_MAX_CHUNK_PAGES);
+        uint32_t num_page_computes;
+        num_pages = update_mandelbrot_pages(frame_page_levels[front_frame_index], &mandelbrot_compute_affine_maps[front_frame_index], num_budget_pages, &num_page_computes);
+        num_chunk_pages = num_page_computes;
+
+        // Once enough samples are in there is nothing left to compute until the camera moves
+        if (num_pages == 0 && frame_num_samples[front_frame_index] >= MANDELBROT_ACCUMULATION_SAMPLES) {
+            idle = true;
+            return result_success;
+        }
+
+        back_frame_index = front_frame_index;
+        accumulate = num_pages == 0;
+    } else if (!back_frame_in_progress) {
+        // Cancelled workers may still be finishing a row of a frame that could be the one recycled
+        if (num_cpu_batch_tiles > 0) {
+            return result_success;
+        }
+
+        size_t next_back_frame_index = get_next_back_frame_index();
+
+        int width;
+        int height;
+        get_camera_framebuffer_size(&width, &height);
+
+        ceil_width = ceil_pow2((uint32_t) width, 8);
+        ceil_height = ceil_pow2((uint32_t) height, 8);
+        margin = get_overscan_margin();
+        scale = get_resolution_scale(still);
+
+        // The image before the last one replaced may still be in use, rather than blocking here just try again next frame
+        if (!does_mandelbrot_image_fit(next_back_frame_index, ceil_width, ceil_height, margin) && retired_mandelbrot_images[next_back_frame_index].pending) {
+            return result_success;
+        }
+
+        back_frame_index = next_back_frame_index;
+    }
+
+    // Both for a recycled frame and for later chunks, a frame in progress is drawn as the overlay every rendered frame, which samples the whole image
+    // Accumulation passes read, blend and write back the very image that is displayed, so they wait for the rendered frames that sample or blit it too
+    if (num_pages == 0) {
+        render_wait_value = mandelbrot_frame_render_values[back_frame_index];
     }
 
-    VkFence command_fence = mandelbrot_fences[back_frame_index];
-    vkResetFences(device, 1, &command_fence);
+    bool begin = false;
+    if (num_pages > 0) {
+        // A chunk of pages alone, with no tiles the classification pass and the kernel have nothing to do
+        write_mandelbrot_compute_parameters(back_frame_index, 0, 0, 0, num_pages);
+    } else if (accumulate) {
+        if ((result = begin_mandelbrot_accumulation_pass(back_frame_index)) != result_success) {
+            return result;
+        }
+    } else if (!back_frame_in_progress) {
+        if ((result = begin_mandelbrot_frame(back_frame_index, ceil_width, ceil_height, margin, scale, MANDELBROT_FOVEATION && !still)) != result_success) {
+            return result;
+        }
+        begin = true;
+    }
+
+    if (num_pages == 0) {
+        // Submit as many tiles as are expected to fit in the budget, but always at least one so the frame makes progress
+        // Tiles that classification fills are cheap, which the measured cost per tile takes into account by itself
+        uint32_t num_remaining_tiles = get_num_mandelbrot_tiles(back_frame_index) - num_back_frame_submitted_tiles - num_back_frame_cpu_tiles;
+        float num_budget_tiles = (float) MANDELBROT_COMPUTE_BUDGET / glm_max(tile_compute_time, 1.0f);
+
+        // The workers run for the whole time until the next rendered frame where the gpu only gets its budget of it
+        // They only take tiles of new frames once the begin command buffer has cleared the image, accumulating reads the image back which is slow from mapped memory
+        float num_cpu_budget_tiles = 0.0f;
+        if (hybrid && back_frame_sample_index == 0 && !begin && num_cpu_batch_tiles == 0) {
+            num_cpu_budget_tiles = (float) get_refresh_interval() / glm_max(cpu_tile_compute_time, 1.0f);
+        }
+
+        uint32_t num_step_tiles;
+        float num_step_budget_tiles = num_budget_tiles + num_cpu_budget_tiles;
+        if (num_step_budget_tiles < 1.0f) {
+            num_step_tiles = 1;
+        } else if (num_step_budget_tiles < (float) num_remaining_tiles) {
+            num_step_tiles = (uint32_t) num_step_budget_tiles;
+        } else {
+            num_step_tiles = num_remaining_tiles;
+        }
+
+        // Split by how many tiles each side gets through, so that both are done with the last of them at about the same time
+        // Each side keeps at least one tile so that its throughput keeps being measured
+        uint32_t num_cpu_tiles = 0;
+        if (num_cpu_budget_tiles > 0.0f && num_step_tiles > 1) {
+            num_cpu_tiles = clamp_uint32((uint32_t) roundf((float) num_step_tiles * num_cpu_budget_tiles / num_step_budget_tiles), 1, num_step_tiles - 1);
+        }
+        num_chunk_tiles = num_step_tiles - num_cpu_tiles;
+
+        if (num_cpu_tiles > 0) {
+            reserve_back_frame_cpu_tiles(num_cpu_tiles);
+        }
+
+        // Pages the frame is filled from are kept from being evicted, and those the page file has are uploaded ahead of the tiles that read them
+        uint32_t num_page_uploads = 0;
+        if (back_frame_sample_index == 0) {
+            uint32_t num_page_computes;
+            num_page_uploads = update_mandelbrot_pages(frame_page_levels[back_frame_index], &mandelbrot_compute_affine_maps[back_frame_index], 0, &num_page_computes);
+        }
+
+        // The command buffers are already recorded, all that is left to do per chunk is to say which tiles
+        write_mandelbrot_compute_parameters(back_frame_index, num_back_frame_submitted_tiles, num_chunk_tiles, back_frame_sample_index, num_page_uploads);
+        num_back_frame_submitted_tiles += num_chunk_tiles;
+    }
+
+    mandelbrot_compute_value++;
+    if (num_pages > 0) {
+        page_chunk_compute_value = mandelbrot_compute_value;
+    } else {
+        mandelbrot_frame_compute_values[back_frame_index] = mandelbrot_compute_value;
+    }
+
+    VkPipelineStageFlags wait_stage_flags = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
     if (vkQueueSubmit(mandelbrot_queue, 1, &(VkSubmitInfo) {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &command_buffer
-    }, command_fence) != VK_SUCCESS) {
+        .pNext = &(VkTimelineSemaphoreSubmitInfo) {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .waitSemaphoreValueCount = 1,
+            .pWaitSemaphoreValues = &render_wait_value,
+            .signalSemaphoreValueCount = 1,
+            .pSignalSemaphoreValues = &mandelbrot_compute_value
+        },
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &render_timeline_semaphore,
+        .pWaitDstStageMask = &wait_stage_flags,
+        .commandBufferCount = begin ? 2 : 1,
+        .pCommandBuffers = begin ? (VkCommandBuffer[2]) { mandelbrot_begin_command_buffers[back_frame_index], mandelbrot_chunk_command_buffers[back_frame_index] } : &mandelbrot_chunk_command_buffers[back_frame_index],
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &mandelbrot_compute_semaphore
+    }, VK_NULL_HANDLE) != VK_SUCCESS) {
         return result_queue_submit_failure;
     }
 
@@ -241,16 +1265,46 @@ result_t manage_mandelbrot_frames(const VkPhysicalDeviceProperties* physical_dev
 }
 
 void term_mandelbrot_management(void) {
+    if (hybrid) {
+        term_mandelbrot_cpu();
+    }
+    free(back_frame_tiles);
+
     vkDestroyCommandPool(device, mandelbrot_command_pool, NULL);
 
     for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
-        vkDestroyFence(device, mandelbrot_fences[i], NULL);
+        if (retired_mandelbrot_images[i].pending) {
+            destroy_retired_mandelbrot_image(&retired_mandelbrot_images[i]);
+        }
         destroy_mandelbrot_image(i);
     }
 
+    term_mandelbrot_page_cache();
+
+    vmaDestroyBuffer(allocator, mandelbrot_parameter_buffer, mandelbrot_parameter_buffer_allocation);
+    vmaDestroyBuffer(allocator, mandelbrot_generation_buffer, mandelbrot_generation_buffer_allocation);
+
+    vkDestroySemaphore(device, mandelbrot_compute_semaphore, NULL);
+
     vkDestroyQueryPool(device, mandelbrot_timestamp_query_pool, NULL);
 }
 
 size_t get_mandelbrot_front_frame_index(void) {
     return front_frame_index;
+}
+
+size_t get_mandelbrot_back_frame_index(void) {
+    return back_frame_index;
+}
+
+bool are_mandelbrot_color_images_mapped(void) {
+    return color_images_mapped;
+}
+
+bool is_mandelbrot_management_idle(void) {
+    return idle;
+}
+
+bool is_mandelbrot_back_frame_in_progress(void) {
+    return back_frame_in_progress && back_frame_index != front_frame_index;
 }
\ No newline at end of file
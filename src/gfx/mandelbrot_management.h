@@ -1,24 +1,157 @@
 #pragma once
+#include "camera.h"
 #include "chrono.h"
 #include "result.h"
 #include <cglm/types-struct.h>
+#include <stdbool.h>
 #include <vulkan/vulkan.h>
 
-#define NUM_MANDELBROT_FRAMES_IN_FLIGHT 2
+// Depth of the ring of frames, at least 2. Beyond that a new frame can start without waiting for the gpu to finish displaying older ones
+#define NUM_MANDELBROT_FRAMES_IN_FLIGHT 3
+
+// Half floats so that accumulated samples keep their precision, must match the image format in mandelbrot.glsl
+#define MANDELBROT_COLOR_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+
+// The same whether color images are mapped or not
+#define MANDELBROT_COLOR_IMAGE_USAGE (VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+
+// Iteration counts of the first sample of every pixel as get_iterations has them, kept apart from the colors so that accumulating samples never averages them. Must match the image format in mandelbrot.glsl and mandelbrot_fragment.frag
+#define MANDELBROT_ITERATION_FORMAT VK_FORMAT_R32_UINT
+#define MANDELBROT_ITERATION_IMAGE_USAGE (VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+
+// Must match TILE_GROUPS in mandelbrot.glsl
+#define MANDELBROT_TILE_GROUPS 8
+#define MANDELBROT_TILE_SIZE (MANDELBROT_TILE_GROUPS*8)
+
+// Must match MAX_ITERATIONS in mandelbrot_kernel.glsl
+#define MANDELBROT_MAX_ITERATIONS 2500
+
+// Entries of the rate buffers hold the rate in the low bits and the position of the tile in the tile list above them. Must match RATE_BITS in mandelbrot.glsl and mandelbrot_fragment.frag
+#define MANDELBROT_RATE_BITS 3
+#define MANDELBROT_RATE_MASK ((1u << MANDELBROT_RATE_BITS) - 1)
+
+// Entries of the parameter rings are spaced by the largest minUniformBufferOffsetAlignment there can be so that any of them can be bound
+#define MANDELBROT_PARAMETER_STRIDE 256
+
+// GPU time that tile chunks may take per rendered frame
+#define MANDELBROT_COMPUTE_BUDGET 4000l
+// Tiles closer than this to the cursor are computed before anything else
+#define MANDELBROT_CURSOR_PRIORITY_RADIUS 192.0f
+// Which camera state frames are computed for, see camera_prediction_t
+#define MANDELBROT_CAMERA_PREDICTION camera_prediction_latency
+
+// While the camera moves only tiles within this many framebuffer pixels of the cursor get a sample for every pixel, further out they get one per 2x2 and then 4x4 pixels
+#define MANDELBROT_FOVEATION true
+#define MANDELBROT_FOVEA_RADIUS 256.0f
+
+// Frames are computed with a guard band around the framebuffer so that reprojection has real data to pull in at the edges
+// The margin follows how fast the view edges are moving, in steps of MANDELBROT_OVERSCAN_MARGIN_STEP pixels which has to be a power of two and a multiple of 8
+#define MANDELBROT_OVERSCAN_MIN_MARGIN 32
+#define MANDELBROT_OVERSCAN_MAX_MARGIN 256
+#define MANDELBROT_OVERSCAN_MARGIN_STEP 32
+
+// While the camera is still the displayed frame keeps getting jittered samples until it has this many
+#define MANDELBROT_ACCUMULATION_SAMPLES 16
+// How far in pixels the view may drift while still counting as still
+#define MANDELBROT_STILL_TOLERANCE 0.125f
+
+// Whether cpu workers compute some of the tiles of new frames next to the gpu, only with mapped color images
+#define MANDELBROT_HYBRID true
+
+// A frame in progress is abandoned when the camera zooms in by more than this from where it was computed
+#define MANDELBROT_STALE_ZOOM_FACTOR 1.5f
+
+// While the camera moves frames are computed at a fraction of the framebuffer resolution so that they take about this long
+#define MANDELBROT_TARGET_FRAME_COMPUTE_TIME 25000l
+#define MANDELBROT_MIN_RESOLUTION_SCALE 0.25f
+#define MANDELBROT_RESOLUTION_SCALE_STEP 0.125f
 
 typedef struct {
+    // In workgroups of the part of the image the frame uses, its top left
     uint32_t width;
     uint32_t height;
+    // In pixels of the whole image, which has room for the frame at full resolution and then some
+    uint32_t image_width;
+    uint32_t image_height;
+    // In pixels of the framebuffer the image covers, which is scaled to the image
+    uint32_t framebuffer_width;
+    uint32_t framebuffer_height;
+    uint32_t margin;
+    float scale;
 } mandelbrot_dispatch_t;
 
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+} mandelbrot_tile_t;
+
+// The indirect dispatch of the kernel followed by the tiles it runs over, both written on the gpu by the classification pass. Must match work_buffer_t in mandelbrot.glsl
+typedef struct {
+    VkDispatchIndirectCommand command;
+    alignas(8) mandelbrot_tile_t tiles[];
+} mandelbrot_work_t;
+
+// One entry of the parameter ring, written by the host before every tile chunk of its frame. Must match parameters_t in mandelbrot.glsl
+typedef struct {
+    // The indirect dispatch of the classification pass, one workgroup per tile of the chunk
+    VkDispatchIndirectCommand classify_command;
+    uint32_t tile_offset;
+    struct {
+        alignas(16) vec3s col;
+    } affine_map[3];
+    uint32_t generation;
+    uint32_t sample_index;
+    vec2s jitter;
+    uint32_t image_width;
+    uint32_t image_height;
+    // The level of the pages that tiles are filled from, or -1 if tiles are not to be filled from pages
+    int32_t page_level;
+    // The indirect dispatch of the page pass, MANDELBROT_TILE_GROUPS by MANDELBROT_TILE_GROUPS workgroups per requested page
+    alignas(16) VkDispatchIndirectCommand page_command;
+} mandelbrot_compute_parameters_t;
+
 extern VkImage mandelbrot_color_images[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 extern VkImageView mandelbrot_color_image_views[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+// Where the pixels of each color image are when they are mapped, rows are the pitch apart in bytes
+// The host writes them in place and they are sampled as is, writes have to be done before the submission that renders them and must not overlap gpu writes to the same pixels
+// Rendered frames that are submitted while the workers write leave those tiles out, see get_mandelbrot_pending_cpu_tiles
+extern void* mandelbrot_color_image_data[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+extern size_t mandelbrot_color_image_row_pitches[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+// Laid out and mapped like the color images, the reconstruction in the render pipeline is guided by them
+extern VkImage mandelbrot_iteration_images[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+extern VkImageView mandelbrot_iteration_image_views[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+extern void* mandelbrot_iteration_image_data[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+extern size_t mandelbrot_iteration_image_row_pitches[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+extern VkBuffer mandelbrot_tile_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+// One sample rate per tile, read by both the kernel and the reconstruction in the render pipeline
+extern VkBuffer mandelbrot_rate_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+extern VkBuffer mandelbrot_rate_staging_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+extern VkBuffer mandelbrot_work_buffers[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 extern mandelbrot_dispatch_t mandelbrot_dispatches[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
-extern size_t mandelbrot_frame_index_to_render_frame_index[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+extern VkBuffer mandelbrot_generation_buffer;
+// An entry of MANDELBROT_PARAMETER_STRIDE bytes for every frame, persistently mapped
+extern VkBuffer mandelbrot_parameter_buffer;
+// Timeline values after which the last compute write to and render read of each frame are done
+extern VkSemaphore mandelbrot_compute_semaphore;
+extern uint64_t mandelbrot_frame_compute_values[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+extern uint64_t mandelbrot_frame_render_values[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 extern mat3s mandelbrot_compute_affine_maps[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 
-result_t init_mandelbrot_management(VkQueue queue, VkCommandBuffer command_buffer, VkFence command_fence, uint32_t queue_family_index);
+result_t init_mandelbrot_management(VkPhysicalDevice physical_device, VkQueue queue, VkCommandBuffer command_buffer, VkFence command_fence, uint32_t queue_family_index, VkQueue compute_queue, uint32_t compute_queue_family_index);
 result_t manage_mandelbrot_frames(const VkPhysicalDeviceProperties* physical_device_properties, microseconds_t* out_mandelbrot_frame_compute_time);
 void term_mandelbrot_management(void);
 
-size_t get_mandelbrot_front_frame_index(void);
\ No newline at end of file
+uint32_t get_num_mandelbrot_tiles(size_t frame_index);
+uint32_t get_mandelbrot_tile_capacity(size_t frame_index);
+size_t get_mandelbrot_front_frame_index(void);
+size_t get_mandelbrot_back_frame_index(void);
+bool is_mandelbrot_back_frame_in_progress(void);
+bool is_mandelbrot_frame_presentable(size_t frame_index);
+// From the normalized coordinates of view to those of the whole image of the frame, exact at any zoom since the frame keeps its view
+mat3s get_mandelbrot_frame_tween_affine_map(size_t frame_index, const camera_view_t* view);
+// Whether color images are linear and persistently mapped, which the device is only given when it reads host visible memory about as fast as its own
+bool are_mandelbrot_color_images_mapped(void);
+// Positions in the tile list of the back frame of the tiles the cpu workers are writing or about to, rendered frames leave them out until they are done
+void get_mandelbrot_pending_cpu_tiles(uint32_t* out_begin, uint32_t* out_end);
+// Whether the last call to manage_mandelbrot_frames found nothing left to compute for the current view
+bool is_mandelbrot_management_idle(void);
\ No newline at end of file
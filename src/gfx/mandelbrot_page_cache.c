@@ -0,0 +1,370 @@
+#include "mandelbrot_page_cache.h"
+#include "gfx/default.h"
+#include "gfx/frame_graph.h"
+#include "gfx/gfx.h"
+#include "gfx/mandelbrot_management.h"
+#include "gfx/mandelbrot_page_file.h"
+#include "result.h"
+#include "util.h"
+#include <cglm/struct/mat3.h>
+#include <cglm/util.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_core.h>
+
+typedef enum {
+    page_slot_state_free,
+    // Computed by the chunk in flight, not in the page table until that chunk is done
+    page_slot_state_pending,
+    page_slot_state_resident
+} page_slot_state_t;
+
+typedef struct {
+    page_slot_state_t state;
+    mandelbrot_page_key_t key;
+    // Neighbours in the least recently used list, which only ever holds resident slots
+    uint32_t newer_slot;
+    uint32_t older_slot;
+    // The last update that found the page in view, such pages are never evicted by that same update
+    uint32_t update_index;
+} page_slot_t;
+
+VkImage mandelbrot_page_atlas_image;
+VkImageView mandelbrot_page_atlas_image_view;
+VkBuffer mandelbrot_page_table_buffer;
+VkBuffer mandelbrot_page_request_buffer;
+VkBuffer mandelbrot_page_transfer_buffer;
+
+static VmaAllocation page_atlas_image_allocation;
+static VmaAllocation page_table_buffer_allocation;
+static VmaAllocation page_request_buffer_allocation;
+static VmaAllocation page_transfer_buffer_allocation;
+static mandelbrot_page_table_entry_t* page_table_data;
+static mandelbrot_page_request_t* page_request_data;
+static uint32_t* page_transfer_data;
+
+// Host copy of the page table, the mapped one is write combined and only ever written
+static mandelbrot_page_table_entry_t page_table[MANDELBROT_PAGE_TABLE_SIZE];
+static page_slot_t page_slots[MANDELBROT_NUM_PAGES];
+
+static uint32_t free_slots[MANDELBROT_NUM_PAGES];
+static uint32_t num_free_slots = 0;
+static uint32_t newest_slot = NULL_UINT32;
+static uint32_t oldest_slot = NULL_UINT32;
+
+static uint32_t pending_slots[MANDELBROT_MAX_CHUNK_PAGES];
+// Where the iterations of each pending page are in the transfer buffer
+static uint32_t pending_request_indices[MANDELBROT_MAX_CHUNK_PAGES];
+static uint32_t num_pending_slots = 0;
+
+static uint32_t update_index = 0;
+
+// Must match get_page_hash in mandelbrot.glsl, which masks it to the page table the same way
+uint32_t get_mandelbrot_page_hash(const mandelbrot_page_key_t* key) {
+    return ((uint32_t) key->x * 73856093u) ^ ((uint32_t) key->y * 19349663u) ^ (key->level * 83492791u) ^ (key->max_iterations * 2654435761u);
+}
+
+static uint32_t get_page_hash(const mandelbrot_page_key_t* key) {
+    return get_mandelbrot_page_hash(key) & (MANDELBROT_PAGE_TABLE_SIZE - 1);
+}
+
+static bool are_page_keys_equal(const mandelbrot_page_key_t* a, const mandelbrot_page_key_t* b) {
+    return a->x == b->x && a->y == b->y && a->level == b->level && a->max_iterations == b->max_iterations;
+}
+
+static void set_page_table_entry(uint32_t index, mandelbrot_page_table_entry_t entry) {
+    page_table[index] = entry;
+    page_table_data[index] = entry;
+}
+
+static uint32_t find_page_table_index(const mandelbrot_page_key_t* key) {
+    for (uint32_t i = 0, index = get_page_hash(key); i < MANDELBROT_PAGE_TABLE_SIZE; i++, index = (index + 1) & (MANDELBROT_PAGE_TABLE_SIZE - 1)) {
+        if (page_table[index].slot == NULL_UINT32) {
+            return NULL_UINT32;
+        }
+        if (are_page_keys_equal(&page_table[index].key, key)) {
+            return index;
+        }
+    }
+    return NULL_UINT32;
+}
+
+// The table never holds more than MANDELBROT_NUM_PAGES entries, so there always is an empty one
+static void insert_page_table_entry(const mandelbrot_page_key_t* key, uint32_t slot) {
+    uint32_t index = get_page_hash(key);
+    while (page_table[index].slot != NULL_UINT32) {
+        index = (index + 1) & (MANDELBROT_PAGE_TABLE_SIZE - 1);
+    }
+    set_page_table_entry(index, (mandelbrot_page_table_entry_t) { *key, slot });
+}
+
+// Entries after the removed one are shifted back into the gap so that lookups can stop at the first empty entry
+static void remove_page_table_entry(uint32_t index) {
+    for (uint32_t next_index = (index + 1) & (MANDELBROT_PAGE_TABLE_SIZE - 1); page_table[next_index].slot != NULL_UINT32; next_index = (next_index + 1) & (MANDELBROT_PAGE_TABLE_SIZE - 1)) {
+        uint32_t hash = get_page_hash(&page_table[next_index].key);
+        // Whether the entry's home lies cyclically within (index, next_index], in which case it has to stay put
+        bool stays = index <= next_index ? (hash > index && hash <= next_index) : (hash > index || hash <= next_index);
+        if (!stays) {
+            set_page_table_entry(index, page_table[next_index]);
+            index = next_index;
+        }
+    }
+    set_page_table_entry(index, (mandelbrot_page_table_entry_t) { .slot = NULL_UINT32 });
+}
+
+static void unlink_page_slot(uint32_t slot) {
+    page_slot_t* page_slot = &page_slots[slot];
+    if (page_slot->newer_slot != NULL_UINT32) {
+        page_slots[page_slot->newer_slot].older_slot = page_slot->older_slot;
+    } else {
+        newest_slot = page_slot->older_slot;
+    }
+    if (page_slot->older_slot != NULL_UINT32) {
+        page_slots[page_slot->older_slot].newer_slot = page_slot->newer_slot;
+    } else {
+        oldest_slot = page_slot->newer_slot;
+    }
+}
+
+static void link_newest_page_slot(uint32_t slot) {
+    page_slot_t* page_slot = &page_slots[slot];
+    page_slot->newer_slot = NULL_UINT32;
+    page_slot->older_slot = newest_slot;
+    if (newest_slot != NULL_UINT32) {
+        page_slots[newest_slot].newer_slot = slot;
+    } else {
+        oldest_slot = slot;
+    }
+    newest_slot = slot;
+    page_slot->update_index = update_index;
+}
+
+// Evicts the least recently used page once the atlas is full, unless that page is in view too
+static uint32_t allocate_page_slot(void) {
+    if (num_free_slots > 0) {
+        return free_slots[--num_free_slots];
+    }
+
+    uint32_t slot = oldest_slot;
+    if (slot == NULL_UINT32 || page_slots[slot].update_index == update_index) {
+        return NULL_UINT32;
+    }
+
+    remove_page_table_entry(find_page_table_index(&page_slots[slot].key));
+    unlink_page_slot(slot);
+    page_slots[slot].state = page_slot_state_free;
+    return slot;
+}
+
+result_t init_mandelbrot_page_cache(const uint32_t queue_family_indices[2]) {
+    bool concurrent = queue_family_indices[0] != queue_family_indices[1];
+
+    if (vmaCreateImage(allocator, &(VkImageCreateInfo) {
+        DEFAULT_VK_IMAGE,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = MANDELBROT_PAGE_FORMAT,
+        .extent = { MANDELBROT_PAGE_ATLAS_PAGES * MANDELBROT_PAGE_SIZE, MANDELBROT_PAGE_ATLAS_PAGES * MANDELBROT_PAGE_SIZE, 1 },
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT,
+        .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = concurrent ? 2 : 0,
+        .pQueueFamilyIndices = queue_family_indices
+    }, &device_allocation_create_info, &mandelbrot_page_atlas_image, &page_atlas_image_allocation, NULL) != VK_SUCCESS) {
+        return result_image_create_failure;
+    }
+
+    if (vkCreateImageView(device, &(VkImageViewCreateInfo) {
+        DEFAULT_VK_IMAGE_VIEW,
+        .image = mandelbrot_page_atlas_image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = MANDELBROT_PAGE_FORMAT,
+        .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT
+    }, NULL, &mandelbrot_page_atlas_image_view) != VK_SUCCESS) {
+        return result_image_view_create_failure;
+    }
+
+    {
+        VmaAllocationInfo page_table_buffer_allocation_info;
+        if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+            DEFAULT_VK_STORAGE_BUFFER,
+            .size = sizeof(page_table),
+            .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = concurrent ? 2 : 0,
+            .pQueueFamilyIndices = queue_family_indices
+        }, &mapped_shared_write_allocation_create_info, &mandelbrot_page_table_buffer, &page_table_buffer_allocation, &page_table_buffer_allocation_info) != VK_SUCCESS) {
+            return result_buffer_create_failure;
+        }
+        page_table_data = page_table_buffer_allocation_info.pMappedData;
+    }
+
+    {
+        VmaAllocationInfo page_request_buffer_allocation_info;
+        if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+            DEFAULT_VK_STORAGE_BUFFER,
+            .size = MANDELBROT_MAX_CHUNK_PAGES * sizeof(mandelbrot_page_request_t),
+            .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = concurrent ? 2 : 0,
+            .pQueueFamilyIndices = queue_family_indices
+        }, &mapped_shared_write_allocation_create_info, &mandelbrot_page_request_buffer, &page_request_buffer_allocation, &page_request_buffer_allocation_info) != VK_SUCCESS) {
+            return result_buffer_create_failure;
+        }
+        page_request_data = page_request_buffer_allocation_info.pMappedData;
+    }
+
+    {
+        VmaAllocationInfo page_transfer_buffer_allocation_info;
+        if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+            DEFAULT_VK_STORAGE_BUFFER,
+            .size = MANDELBROT_MAX_CHUNK_PAGES * MANDELBROT_PAGE_SIZE * MANDELBROT_PAGE_SIZE * sizeof(uint32_t),
+            .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+            .queueFamilyIndexCount = concurrent ? 2 : 0,
+            .pQueueFamilyIndices = queue_family_indices
+        }, &mapped_shared_read_allocation_create_info, &mandelbrot_page_transfer_buffer, &page_transfer_buffer_allocation, &page_transfer_buffer_allocation_info) != VK_SUCCESS) {
+            return result_buffer_create_failure;
+        }
+        page_transfer_data = page_transfer_buffer_allocation_info.pMappedData;
+    }
+
+    for (uint32_t i = 0; i < MANDELBROT_PAGE_TABLE_SIZE; i++) {
+        page_table[i] = (mandelbrot_page_table_entry_t) { .slot = NULL_UINT32 };
+    }
+    memcpy(page_table_data, page_table, sizeof(page_table));
+
+    // Handed out from the start of the atlas
+    for (uint32_t i = 0; i < MANDELBROT_NUM_PAGES; i++) {
+        page_slots[i].state = page_slot_state_free;
+        free_slots[i] = MANDELBROT_NUM_PAGES - 1 - i;
+    }
+    num_free_slots = MANDELBROT_NUM_PAGES;
+
+    init_mandelbrot_page_file();
+
+    return result_success;
+}
+
+// The atlas stays in the general layout for its whole lifetime, only the page table says which parts of it hold anything
+void record_mandelbrot_page_cache_init(VkCommandBuffer command_buffer) {
+    frame_graph_t graph;
+    init_frame_graph(&graph);
+
+    uint32_t atlas_image = add_frame_graph_image(&graph, mandelbrot_page_atlas_image, 1, &(frame_graph_usage_t) { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED });
+    add_frame_graph_pass(&graph, NULL, NULL, 1, (frame_graph_access_t[]) {
+        { atlas_image, { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL }, true }
+    });
+
+    record_frame_graph(&graph, command_buffer);
+}
+
+void term_mandelbrot_page_cache(void) {
+    term_mandelbrot_page_file();
+
+    vmaDestroyBuffer(allocator, mandelbrot_page_transfer_buffer, page_transfer_buffer_allocation);
+    vmaDestroyBuffer(allocator, mandelbrot_page_request_buffer, page_request_buffer_allocation);
+    vmaDestroyBuffer(allocator, mandelbrot_page_table_buffer, page_table_buffer_allocation);
+    vkDestroyImageView(device, mandelbrot_page_atlas_image_view, NULL);
+    vmaDestroyImage(allocator, mandelbrot_page_atlas_image, page_atlas_image_allocation);
+}
+
+// The coarsest level whose texels are no larger than the frame's pixels, or -1 if the frame is zoomed out past level 0 or in past the last level
+int32_t get_mandelbrot_page_level(const mat3s* affine_map, uint32_t image_width, uint32_t image_height) {
+    float pixel_size = glm_min(2.0f * fabsf(affine_map->col[0].x) / (float) image_width, 2.0f * fabsf(affine_map->col[1].y) / (float) image_height);
+    float level = ceilf(log2f(MANDELBROT_PAGE_ROOT_EXTENT / ((float) MANDELBROT_PAGE_SIZE * pixel_size)));
+    if (!(level >= 0.0f && level <= (float) MANDELBROT_PAGE_MAX_LEVEL)) {
+        return -1;
+    }
+    return (int32_t) level;
+}
+
+// Marks the pages of the view as recently used and requests the missing ones, which the next chunk fills
+// Pages in the page file are uploaded and can be looked up right away since the chunk fills them before anything reads them
+// Up to max_num_computes of the others are computed, those have to be completed before the next update
+// Returns how many were requested in total
+uint32_t update_mandelbrot_pages(int32_t level, const mat3s* affine_map, uint32_t max_num_computes, uint32_t* out_num_computes) {
+    update_index++;
+    num_pending_slots = 0;
+    *out_num_computes = 0;
+
+    if (level < 0) {
+        return 0;
+    }
+
+    // The view spans normalized coordinates from -1 to 1, which may be flipped in the complex plane
+    float extent = ldexpf(MANDELBROT_PAGE_ROOT_EXTENT, -level);
+    vec3s a = glms_mat3_mulv(*affine_map, (vec3s) {{ -1.0f, -1.0f, 1.0f }});
+    vec3s b = glms_mat3_mulv(*affine_map, (vec3s) {{ 1.0f, 1.0f, 1.0f }});
+    vec2s min = {{ floorf(glm_min(a.x, b.x) / extent), floorf(glm_min(a.y, b.y) / extent) }};
+    vec2s max = {{ floorf(glm_max(a.x, b.x) / extent), floorf(glm_max(a.y, b.y) / extent) }};
+
+    // Far enough out that page coordinates no longer fit, or a view that does not fit in the atlas and would only evict itself
+    if (glm_max(fabsf(min.x), fabsf(min.y)) >= (float) INT32_MAX / 2.0f || glm_max(fabsf(max.x), fabsf(max.y)) >= (float) INT32_MAX / 2.0f || (max.x - min.x + 1.0f) * (max.y - min.y + 1.0f) > (float) MANDELBROT_NUM_PAGES) {
+        return 0;
+    }
+    int32_t min_x = (int32_t) min.x;
+    int32_t min_y = (int32_t) min.y;
+    int32_t max_x = (int32_t) max.x;
+    int32_t max_y = (int32_t) max.y;
+
+    // Everything in view is touched before anything is evicted
+    for (int32_t y = min_y; y <= max_y; y++) {
+        for (int32_t x = min_x; x <= max_x; x++) {
+            uint32_t index = find_page_table_index(&(mandelbrot_page_key_t) { x, y, (uint32_t) level, MANDELBROT_MAX_ITERATIONS });
+            if (index != NULL_UINT32) {
+                unlink_page_slot(page_table[index].slot);
+                link_newest_page_slot(page_table[index].slot);
+            }
+        }
+    }
+
+    uint32_t num_requests = 0;
+    for (int32_t y = min_y; y <= max_y && num_requests < MANDELBROT_MAX_CHUNK_PAGES; y++) {
+        for (int32_t x = min_x; x <= max_x && num_requests < MANDELBROT_MAX_CHUNK_PAGES; x++) {
+            mandelbrot_page_key_t key = { x, y, (uint32_t) level, MANDELBROT_MAX_ITERATIONS };
+            if (find_page_table_index(&key) != NULL_UINT32) {
+                continue;
+            }
+
+            uint32_t* iterations = page_transfer_data + (num_requests * MANDELBROT_PAGE_SIZE * MANDELBROT_PAGE_SIZE);
+            bool uploaded = read_mandelbrot_page_record(&key, iterations);
+            if (!uploaded && num_pending_slots == max_num_computes) {
+                continue;
+            }
+
+            uint32_t slot = allocate_page_slot();
+            if (slot == NULL_UINT32) {
+                *out_num_computes = num_pending_slots;
+                return num_requests;
+            }
+
+            page_slots[slot].key = key;
+            page_request_data[num_requests] = (mandelbrot_page_request_t) { x, y, (uint32_t) level, slot, uploaded };
+            if (uploaded) {
+                page_slots[slot].state = page_slot_state_resident;
+                insert_page_table_entry(&key, slot);
+                link_newest_page_slot(slot);
+            } else {
+                page_slots[slot].state = page_slot_state_pending;
+                pending_request_indices[num_pending_slots] = num_requests;
+                pending_slots[num_pending_slots++] = slot;
+            }
+            num_requests++;
+        }
+    }
+
+    *out_num_computes = num_pending_slots;
+    return num_requests;
+}
+
+// Only called once the chunk that computed the requested pages is done, from then on lookups find them and the page file keeps them
+void complete_mandelbrot_page_requests(void) {
+    for (uint32_t i = 0; i < num_pending_slots; i++) {
+        uint32_t slot = pending_slots[i];
+        page_slots[slot].state = page_slot_state_resident;
+        insert_page_table_entry(&page_slots[slot].key, slot);
+        link_newest_page_slot(slot);
+
+        write_mandelbrot_page_record(&page_slots[slot].key, page_transfer_data + (pending_request_indices[i] * MANDELBROT_PAGE_SIZE * MANDELBROT_PAGE_SIZE));
+    }
+    num_pending_slots = 0;
+}
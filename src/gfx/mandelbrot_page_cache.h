@@ -0,0 +1,63 @@
+#pragma once
+#include "result.h"
+#include <cglm/types-struct.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// Pages are square pieces of the complex plane, MANDELBROT_PAGE_ROOT_EXTENT wide at level 0 and half as wide with every level after that
+// Must match PAGE_SIZE and PAGE_ROOT_EXTENT in mandelbrot.glsl
+#define MANDELBROT_PAGE_SIZE 64
+#define MANDELBROT_PAGE_ROOT_EXTENT 4.0f
+// Past this page coordinates no longer fit and single precision has long run out anyway
+#define MANDELBROT_PAGE_MAX_LEVEL 30
+
+// Pages hold iteration counts rather than colors, see get_iterations in mandelbrot.glsl
+#define MANDELBROT_PAGE_FORMAT VK_FORMAT_R32_UINT
+// Pages per side of the atlas, enough for a few views at the finest level a frame uses
+#define MANDELBROT_PAGE_ATLAS_PAGES 64
+#define MANDELBROT_NUM_PAGES (MANDELBROT_PAGE_ATLAS_PAGES*MANDELBROT_PAGE_ATLAS_PAGES)
+// Open addressed and at most a quarter full so that probes stay short. Must match PAGE_ATLAS_PAGES and PAGE_TABLE_SIZE in mandelbrot.glsl
+#define MANDELBROT_PAGE_TABLE_SIZE (4*MANDELBROT_NUM_PAGES)
+
+// Most pages a single chunk fills, computed ones are about as much work as a tile each and are held back further by the budget
+#define MANDELBROT_MAX_CHUNK_PAGES 256
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+    uint32_t level;
+    uint32_t max_iterations;
+} mandelbrot_page_key_t;
+
+// Must match page_table_entry_t in mandelbrot.glsl
+typedef struct {
+    mandelbrot_page_key_t key;
+    uint32_t slot;
+} mandelbrot_page_table_entry_t;
+
+// Must match page_request_t in mandelbrot.glsl
+typedef struct {
+    int32_t x;
+    int32_t y;
+    uint32_t level;
+    uint32_t slot;
+    // Whether the page comes from the page file through the transfer buffer rather than being computed
+    uint32_t uploaded;
+} mandelbrot_page_request_t;
+
+extern VkImage mandelbrot_page_atlas_image;
+extern VkImageView mandelbrot_page_atlas_image_view;
+// Persistently mapped, only written while no chunk is in flight
+extern VkBuffer mandelbrot_page_table_buffer;
+extern VkBuffer mandelbrot_page_request_buffer;
+// The iterations of every requested page, by request, written by the host for uploaded pages and by the gpu for computed ones
+extern VkBuffer mandelbrot_page_transfer_buffer;
+
+result_t init_mandelbrot_page_cache(const uint32_t queue_family_indices[2]);
+void record_mandelbrot_page_cache_init(VkCommandBuffer command_buffer);
+void term_mandelbrot_page_cache(void);
+
+uint32_t get_mandelbrot_page_hash(const mandelbrot_page_key_t* key);
+int32_t get_mandelbrot_page_level(const mat3s* affine_map, uint32_t image_width, uint32_t image_height);
+uint32_t update_mandelbrot_pages(int32_t level, const mat3s* affine_map, uint32_t max_num_computes, uint32_t* out_num_computes);
+void complete_mandelbrot_page_requests(void);
@@ -0,0 +1,220 @@
+// ftruncate is POSIX rather than C, it has to be asked for before any system header
+#define _POSIX_C_SOURCE 200809L
+#include "mandelbrot_page_file.h"
+#include "util.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PAGE_FILE_MAGIC 0x4742504du
+#define PAGE_FILE_VERSION 1u
+// Records start on their own os page so that the header is never torn along with one
+#define PAGE_FILE_RECORD_OFFSET 4096
+// Open addressed and at most half full
+#define PAGE_FILE_INDEX_SIZE (2*MANDELBROT_PAGE_FILE_NUM_RECORDS)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    // Anything that changes what a record holds, a file written with other values is started over
+    uint32_t page_size;
+    uint32_t num_records;
+} page_file_header_t;
+
+typedef struct {
+    mandelbrot_page_key_t key;
+    // Zero for a record that was never written, otherwise larger for newer records
+    uint64_t sequence;
+    // Over the key, the sequence and the iterations, a record torn by a crash fails it and is dropped when read
+    uint32_t checksum;
+    uint32_t padding;
+    uint32_t iterations[MANDELBROT_PAGE_SIZE*MANDELBROT_PAGE_SIZE];
+} page_file_record_t;
+
+#define PAGE_FILE_SIZE (PAGE_FILE_RECORD_OFFSET + (MANDELBROT_PAGE_FILE_NUM_RECORDS*sizeof(page_file_record_t)))
+
+static void* file_data = NULL;
+static page_file_record_t* records;
+
+// Never stored in the file, it is rebuilt from the records on startup so that there is no index to keep consistent with them
+static uint32_t record_index_table[PAGE_FILE_INDEX_SIZE];
+
+// Records are written as a ring, the next one is the oldest
+static uint32_t next_record_index = 0;
+static uint64_t next_sequence = 1;
+
+static bool are_page_keys_equal(const mandelbrot_page_key_t* a, const mandelbrot_page_key_t* b) {
+    return a->x == b->x && a->y == b->y && a->level == b->level && a->max_iterations == b->max_iterations;
+}
+
+// FNV-1a over words rather than bytes, it only has to catch torn records
+static uint32_t get_record_checksum(const mandelbrot_page_key_t* key, uint64_t sequence, const uint32_t* iterations) {
+    uint32_t checksum = 2166136261u;
+    uint32_t words[6] = { (uint32_t) key->x, (uint32_t) key->y, key->level, key->max_iterations, (uint32_t) sequence, (uint32_t) (sequence >> 32) };
+    for (size_t i = 0; i < NUM_ELEMS(words); i++) {
+        checksum = (checksum ^ words[i]) * 16777619u;
+    }
+    for (size_t i = 0; i < MANDELBROT_PAGE_SIZE*MANDELBROT_PAGE_SIZE; i++) {
+        checksum = (checksum ^ iterations[i]) * 16777619u;
+    }
+    return checksum;
+}
+
+static uint32_t find_record_index_table_index(const mandelbrot_page_key_t* key) {
+    for (uint32_t i = 0, index = get_mandelbrot_page_hash(key) & (PAGE_FILE_INDEX_SIZE - 1); i < PAGE_FILE_INDEX_SIZE; i++, index = (index + 1) & (PAGE_FILE_INDEX_SIZE - 1)) {
+        if (record_index_table[index] == NULL_UINT32) {
+            return NULL_UINT32;
+        }
+        if (are_page_keys_equal(&records[record_index_table[index]].key, key)) {
+            return index;
+        }
+    }
+    return NULL_UINT32;
+}
+
+// Replaces the record of the same key if there is one, the table never holds more than MANDELBROT_PAGE_FILE_NUM_RECORDS entries
+static void insert_record_index_table_entry(uint32_t record_index) {
+    uint32_t index = get_mandelbrot_page_hash(&records[record_index].key) & (PAGE_FILE_INDEX_SIZE - 1);
+    while (record_index_table[index] != NULL_UINT32 && !are_page_keys_equal(&records[record_index_table[index]].key, &records[record_index].key)) {
+        index = (index + 1) & (PAGE_FILE_INDEX_SIZE - 1);
+    }
+    record_index_table[index] = record_index;
+}
+
+// Same backward shift as the page table in mandelbrot_page_cache.c
+static void remove_record_index_table_entry(uint32_t index) {
+    for (uint32_t next_index = (index + 1) & (PAGE_FILE_INDEX_SIZE - 1); record_index_table[next_index] != NULL_UINT32; next_index = (next_index + 1) & (PAGE_FILE_INDEX_SIZE - 1)) {
+        uint32_t hash = get_mandelbrot_page_hash(&records[record_index_table[next_index]].key) & (PAGE_FILE_INDEX_SIZE - 1);
+        bool stays = index <= next_index ? (hash > index && hash <= next_index) : (hash > index || hash <= next_index);
+        if (!stays) {
+            record_index_table[index] = record_index_table[next_index];
+            index = next_index;
+        }
+    }
+    record_index_table[index] = NULL_UINT32;
+}
+
+void init_mandelbrot_page_file(void) {
+    int fd = open(MANDELBROT_PAGE_FILE_PATH, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        return;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        close(fd);
+        return;
+    }
+
+    // A file of the wrong size is truncated to nothing first, which zeroes every record
+    bool reset = (size_t) file_stat.st_size != PAGE_FILE_SIZE;
+    if (reset && (ftruncate(fd, 0) == -1 || ftruncate(fd, (off_t) PAGE_FILE_SIZE) == -1)) {
+        close(fd);
+        return;
+    }
+
+    void* data = mmap(NULL, PAGE_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // The mapping keeps the file open by itself
+    close(fd);
+    if (data == MAP_FAILED) {
+        return;
+    }
+    file_data = data;
+    records = (page_file_record_t*) (file_data + PAGE_FILE_RECORD_OFFSET);
+
+    page_file_header_t* header = file_data;
+    page_file_header_t expected_header = { PAGE_FILE_MAGIC, PAGE_FILE_VERSION, MANDELBROT_PAGE_SIZE, MANDELBROT_PAGE_FILE_NUM_RECORDS };
+    if (reset || memcmp(header, &expected_header, sizeof(expected_header)) != 0) {
+        for (size_t i = 0; i < MANDELBROT_PAGE_FILE_NUM_RECORDS; i++) {
+            records[i].sequence = 0;
+        }
+        *header = expected_header;
+    }
+
+    for (size_t i = 0; i < PAGE_FILE_INDEX_SIZE; i++) {
+        record_index_table[i] = NULL_UINT32;
+    }
+
+    // Only the headers of the records are read here, checksums are checked when a record is actually read
+    uint64_t newest_sequence = 0;
+    for (uint32_t i = 0; i < MANDELBROT_PAGE_FILE_NUM_RECORDS; i++) {
+        uint64_t sequence = records[i].sequence;
+        if (sequence == 0) {
+            continue;
+        }
+
+        uint32_t index = find_record_index_table_index(&records[i].key);
+        if (index == NULL_UINT32 || records[record_index_table[index]].sequence < sequence) {
+            insert_record_index_table_entry(i);
+        }
+
+        if (sequence > newest_sequence) {
+            newest_sequence = sequence;
+            next_record_index = (i + 1) % MANDELBROT_PAGE_FILE_NUM_RECORDS;
+        }
+    }
+    next_sequence = newest_sequence + 1;
+}
+
+void term_mandelbrot_page_file(void) {
+    if (file_data == NULL) {
+        return;
+    }
+    msync(file_data, PAGE_FILE_SIZE, MS_SYNC);
+    munmap(file_data, PAGE_FILE_SIZE);
+    file_data = NULL;
+}
+
+// Returns whether the page was in the file, a record that fails its checksum is dropped
+bool read_mandelbrot_page_record(const mandelbrot_page_key_t* key, uint32_t* iterations) {
+    if (file_data == NULL) {
+        return false;
+    }
+
+    uint32_t index = find_record_index_table_index(key);
+    if (index == NULL_UINT32) {
+        return false;
+    }
+
+    const page_file_record_t* record = &records[record_index_table[index]];
+    if (record->checksum != get_record_checksum(&record->key, record->sequence, record->iterations)) {
+        remove_record_index_table_entry(index);
+        return false;
+    }
+
+    memcpy(iterations, record->iterations, sizeof(record->iterations));
+    return true;
+}
+
+// Nothing is synced here, a crash may lose the newest records but never hands out a torn one
+void write_mandelbrot_page_record(const mandelbrot_page_key_t* key, const uint32_t* iterations) {
+    if (file_data == NULL) {
+        return;
+    }
+
+    uint32_t record_index = next_record_index;
+    next_record_index = (next_record_index + 1) % MANDELBROT_PAGE_FILE_NUM_RECORDS;
+    page_file_record_t* record = &records[record_index];
+
+    // The oldest record makes way, unless a newer record of the same page is what the index points at
+    if (record->sequence != 0) {
+        uint32_t index = find_record_index_table_index(&record->key);
+        if (index != NULL_UINT32 && record_index_table[index] == record_index) {
+            remove_record_index_table_entry(index);
+        }
+    }
+
+    // Invalidated before anything else is written so that a crash midway leaves a record that is skipped on startup
+    record->sequence = 0;
+    record->key = *key;
+    memcpy(record->iterations, iterations, sizeof(record->iterations));
+    record->checksum = get_record_checksum(key, next_sequence, iterations);
+    record->sequence = next_sequence++;
+
+    insert_record_index_table_entry(record_index);
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "gfx/mandelbrot_page_cache.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Pages outlive the process in a memory mapped file, looked up relative to the working directory like the shaders
+#define MANDELBROT_PAGE_FILE_PATH "mandelbrot_pages.cache"
+// Bounds the file to about 64MiB, once it is full the oldest records are overwritten first
+#define MANDELBROT_PAGE_FILE_NUM_RECORDS 4096
+
+// The file is only a cache, if it cannot be opened every page is simply computed
+void init_mandelbrot_page_file(void);
+void term_mandelbrot_page_file(void);
+
+bool read_mandelbrot_page_record(const mandelbrot_page_key_t* key, uint32_t* iterations);
+void write_mandelbrot_page_record(const mandelbrot_page_key_t* key, const uint32_t* iterations);
@@ -14,43 +14,37 @@
 #include <vulkan/vulkan.h>
 
 typedef struct {
-    struct {
-        alignas(16) vec3s col;
-    } affine_map[3];
+    uint32_t layer;
 } push_constants_t;
 
-static vec2s mandelbrot_vertices[4] = {
-    {{ 1.0f, 1.0f }},
-    {{ 1.0f, -1.0f }},
-    {{ -1.0f, -1.0f }},
-    {{ -1.0f, 1.0f }},
-};
-
-static uint16_t mandelbrot_indices[6] = {
-    0, 1, 3,
-    1, 2, 3
-};
+// Must match parameters_t in mandelbrot_vertex.vert and mandelbrot_fragment.frag
+typedef struct {
+    struct {
+        alignas(16) vec3s col;
+    } affine_maps[2][3];
+    // The used part of the front and back images, which may be larger
+    alignas(16) uint32_t image_extents[4];
+    // The back frame's tiles the cpu workers may be writing, which are left out
+    uint32_t pending_tiles[2];
+} parameters_t;
 
 static pipeline_t pipeline;
 static VkDescriptorSetLayout descriptor_set_layout;
-static VkDescriptorSet descriptor_sets[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
-
-static VkBuffer vertex_staging_buffer;
-static VmaAllocation vertex_staging_buffer_allocation;
-static VkBuffer vertex_buffer;
-static VmaAllocation vertex_buffer_allocation;
-
-static VkBuffer index_staging_buffer;
-static VmaAllocation index_staging_buffer_allocation;
-static VkBuffer index_buffer;
-static VmaAllocation index_buffer_allocation;
+// Replacing an image writes the other set of its frame, the current one may still be bound in a frame being rendered
+static VkDescriptorSet descriptor_sets[NUM_MANDELBROT_FRAMES_IN_FLIGHT][2];
+static size_t descriptor_set_parities[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
 
 static VkSampler color_sampler;
 
-result_t init_mandelbrot_render_pipeline(VkQueue queue, VkCommandBuffer command_buffer, VkFence command_fence, VkDescriptorPool descriptor_pool, const VkPhysicalDeviceProperties* physical_device_properties) {
-    (void) physical_device_properties;
-    (void) descriptor_pool;
+// One entry per frame in flight, an entry is only written once the frame that last read it is done
+static VkBuffer parameter_buffer;
+static VmaAllocation parameter_buffer_allocation;
+static void* parameter_data;
+
+// Bumped whenever a descriptor set changes, which invalidates the command buffers it was bound in
+static uint32_t version = 0;
 
+result_t init_mandelbrot_render_pipeline(VkDescriptorPool descriptor_pool, const VkPhysicalDeviceProperties* physical_device_properties) {
     result_t result;
     
     VkShaderModule vertex_shader_module;
@@ -64,13 +58,31 @@ result_t init_mandelbrot_render_pipeline(VkQueue queue, VkCommandBuffer command_
 
     if (vkCreateDescriptorSetLayout(device, &(VkDescriptorSetLayoutCreateInfo) {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        .bindingCount = 1,
-        .pBindings = (VkDescriptorSetLayoutBinding[1]) {
+        .bindingCount = 4,
+        .pBindings = (VkDescriptorSetLayoutBinding[4]) {
             {
                 DEFAULT_VK_DESCRIPTOR_BINDING,
                 .binding = 0,
                 .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                 .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 2,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
+            },
+            {
+                DEFAULT_VK_DESCRIPTOR_BINDING,
+                .binding = 3,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
             }
         }
     }, NULL, &descriptor_set_layout) != VK_SUCCESS) {
@@ -78,17 +90,17 @@ result_t init_mandelbrot_render_pipeline(VkQueue queue, VkCommandBuffer command_
     }
     
     {
-        VkDescriptorSetLayout set_layouts[NUM_MANDELBROT_FRAMES_IN_FLIGHT];
-        for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
+        VkDescriptorSetLayout set_layouts[2 * NUM_MANDELBROT_FRAMES_IN_FLIGHT];
+        for (size_t i = 0; i < 2 * NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
             set_layouts[i] = descriptor_set_layout;
         }
 
         if (vkAllocateDescriptorSets(device, &(VkDescriptorSetAllocateInfo) {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
             .descriptorPool = descriptor_pool,
-            .descriptorSetCount = NUM_MANDELBROT_FRAMES_IN_FLIGHT,
+            .descriptorSetCount = 2 * NUM_MANDELBROT_FRAMES_IN_FLIGHT,
             .pSetLayouts = set_layouts
-        }, descriptor_sets) != VK_SUCCESS) {
+        }, &descriptor_sets[0][0]) != VK_SUCCESS) {
             return result_descriptor_sets_allocate_failure;
         }
     }
@@ -101,7 +113,7 @@ result_t init_mandelbrot_render_pipeline(VkQueue queue, VkCommandBuffer command_
         },
         .pushConstantRangeCount = 1,
         .pPushConstantRanges = &(VkPushConstantRange) {
-            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+            .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
             .size = sizeof(push_constants_t)
         }
     }, NULL, &pipeline.pipeline_layout) != VK_SUCCESS) {
@@ -125,35 +137,23 @@ result_t init_mandelbrot_render_pipeline(VkQueue queue, VkCommandBuffer command_
             }
         },
 
+        // The fullscreen triangle comes from the vertex index alone
         .pVertexInputState = &(VkPipelineVertexInputStateCreateInfo) {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        
-            .vertexBindingDescriptionCount = 1,
-            .pVertexBindingDescriptions = (VkVertexInputBindingDescription[1]) {
-                {
-                    .binding = 0,
-                    .stride = sizeof(vec2s),
-                    .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
-                }
-            },
-
-            .vertexAttributeDescriptionCount = 1,
-            .pVertexAttributeDescriptions = (VkVertexInputAttributeDescription[1]) {
-                {
-                    .binding = 0,
-                    .location = 0,
-                    .format = VK_FORMAT_R32G32_SFLOAT,
-                    .offset = 0
-                }
-            }
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO
         },
         .pRasterizationState = &(VkPipelineRasterizationStateCreateInfo) { DEFAULT_VK_RASTERIZATION },
-        .pMultisampleState = &(VkPipelineMultisampleStateCreateInfo) {
-            DEFAULT_VK_MULTISAMPLE,
-            .rasterizationSamples = render_multisample_flags
-        },
+        // Every pixel is covered by the triangle whole, multisampling would only add resolve bandwidth
+        .pMultisampleState = &(VkPipelineMultisampleStateCreateInfo) { DEFAULT_VK_MULTISAMPLE },
+        // The frame that is still being computed is drawn over the previous one, uncomputed tiles are transparent
+        .pColorBlendState = &default_alpha_blend_create_info,
         .layout = pipeline.pipeline_layout,
-        .renderPass = frame_render_pass
+        // Drawn with dynamic rendering straight into the swapchain image
+        .pNext = &(VkPipelineRenderingCreateInfo) {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+            .colorAttachmentCount = 1,
+            .pColorAttachmentFormats = &surface_format.format
+        },
+        .renderPass = VK_NULL_HANDLE
     }, NULL, &pipeline.pipeline) != VK_SUCCESS) {
         return result_graphics_pipelines_create_failure;
     }
@@ -161,70 +161,6 @@ result_t init_mandelbrot_render_pipeline(VkQueue queue, VkCommandBuffer command_
     vkDestroyShaderModule(device, fragment_shader_module, NULL);
     vkDestroyShaderModule(device, vertex_shader_module, NULL);
 
-    if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
-        DEFAULT_VK_VERTEX_BUFFER,
-        .size = sizeof(mandelbrot_vertices)
-    }, &device_allocation_create_info, &vertex_buffer, &vertex_buffer_allocation, NULL) != VK_SUCCESS) {
-        return result_buffer_create_failure;
-    }
-
-    if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
-        DEFAULT_VK_INDEX_BUFFER,
-        .size = sizeof(mandelbrot_indices)
-    }, &device_allocation_create_info, &index_buffer, &index_buffer_allocation, NULL) != VK_SUCCESS) {
-        return result_buffer_create_failure;
-    }
-
-    if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
-        DEFAULT_VK_STAGING_BUFFER,
-        .size = sizeof(mandelbrot_vertices)
-    }, &shared_write_allocation_create_info, &vertex_staging_buffer, &vertex_staging_buffer_allocation, NULL) != VK_SUCCESS) {
-        return result_buffer_create_failure;
-    }
-
-    if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
-        DEFAULT_VK_STAGING_BUFFER,
-        .size = sizeof(mandelbrot_indices)
-    }, &shared_write_allocation_create_info, &index_staging_buffer, &index_staging_buffer_allocation, NULL) != VK_SUCCESS) {
-        return result_buffer_create_failure;
-    }
-    
-    if ((result = write_to_buffer(vertex_staging_buffer_allocation, sizeof(mandelbrot_vertices), mandelbrot_vertices)) != result_success) {
-        return result;
-    }
-    
-    if ((result = write_to_buffer(index_staging_buffer_allocation, sizeof(mandelbrot_indices), mandelbrot_indices)) != result_success) {
-        return result;
-    }
-
-    if (vkBeginCommandBuffer(command_buffer, &(VkCommandBufferBeginInfo) {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
-    }) != VK_SUCCESS) {
-        return result_command_buffer_begin_failure;
-    }
-
-    vkCmdCopyBuffer(command_buffer, vertex_staging_buffer, vertex_buffer, 1, &(VkBufferCopy) {
-        .size = sizeof(mandelbrot_vertices)
-    });
-    vkCmdCopyBuffer(command_buffer, index_staging_buffer, index_buffer, 1, &(VkBufferCopy) {
-        .size = sizeof(mandelbrot_indices)
-    });
-    
-    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-        return result_command_buffer_end_failure;
-    }
-
-    if ((result = submit_and_wait(queue, command_buffer, command_fence)) != result_success) {
-        return result;
-    }
-    if ((result = reset_command_processing(command_buffer, command_fence)) != result_success) {
-        return result;
-    }
-
-    vmaDestroyBuffer(allocator, index_staging_buffer, index_staging_buffer_allocation);
-    vmaDestroyBuffer(allocator, vertex_staging_buffer, vertex_staging_buffer_allocation);
-
     if (vkCreateSampler(device, &(VkSamplerCreateInfo) {
         DEFAULT_VK_SAMPLER,
         .maxAnisotropy = physical_device_properties->limits.maxSamplerAnisotropy,
@@ -238,16 +174,32 @@ result_t init_mandelbrot_render_pipeline(VkQueue queue, VkCommandBuffer command_
         return result_sampler_create_failure;
     }
 
-    update_mandelbrot_render_pipeline(get_mandelbrot_front_frame_index());
+    {
+        VmaAllocationInfo parameter_buffer_allocation_info;
+        if (vmaCreateBuffer(allocator, &(VkBufferCreateInfo) {
+            DEFAULT_VK_UNIFORM_BUFFER,
+            .size = NUM_FRAMES_IN_FLIGHT * MANDELBROT_PARAMETER_STRIDE
+        }, &mapped_shared_write_allocation_create_info, &parameter_buffer, &parameter_buffer_allocation, &parameter_buffer_allocation_info) != VK_SUCCESS) {
+            return result_buffer_create_failure;
+        }
+        parameter_data = parameter_buffer_allocation_info.pMappedData;
+    }
+
+    for (size_t i = 0; i < NUM_MANDELBROT_FRAMES_IN_FLIGHT; i++) {
+        update_mandelbrot_render_pipeline(i);
+    }
 
     return result_success;
 }
 
 void update_mandelbrot_render_pipeline(size_t frame_index) {
-    vkUpdateDescriptorSets(device, 1, (VkWriteDescriptorSet[1]) {
+    descriptor_set_parities[frame_index] ^= 1;
+    VkDescriptorSet descriptor_set = descriptor_sets[frame_index][descriptor_set_parities[frame_index]];
+
+    vkUpdateDescriptorSets(device, 4, (VkWriteDescriptorSet[4]) {
         {
             .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-            .dstSet = descriptor_sets[frame_index],
+            .dstSet = descriptor_set,
             .dstBinding = 0,
             .dstArrayElement = 0,
             .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
@@ -255,37 +207,91 @@ void update_mandelbrot_render_pipeline(size_t frame_index) {
             .pImageInfo = &(VkDescriptorImageInfo) {
                 .sampler = color_sampler,
                 .imageView = mandelbrot_color_image_views[frame_index],
-                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = 1,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = mandelbrot_rate_buffers[frame_index],
+                .offset = 0,
+                .range = VK_WHOLE_SIZE
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = 2,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            .descriptorCount = 1,
+            .pBufferInfo = &(VkDescriptorBufferInfo) {
+                .buffer = parameter_buffer,
+                .offset = 0,
+                .range = sizeof(parameters_t)
+            }
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = descriptor_set,
+            .dstBinding = 3,
+            .dstArrayElement = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            .descriptorCount = 1,
+            .pImageInfo = &(VkDescriptorImageInfo) {
+                .imageView = mandelbrot_iteration_image_views[frame_index],
+                .imageLayout = VK_IMAGE_LAYOUT_GENERAL
             }
         }
     }, 0, NULL);
+
+    version++;
 }
 
-result_t draw_mandelbrot_render_pipeline(VkCommandBuffer command_buffer, size_t mandelbrot_frame_index, size_t render_frame_index, const mat3s* affine_map) {
-    mandelbrot_frame_index_to_render_frame_index[mandelbrot_frame_index] = render_frame_index;
+uint32_t get_mandelbrot_render_pipeline_version(void) {
+    return version;
+}
 
-    push_constants_t push_constants;
+void write_mandelbrot_render_pipeline_parameters(size_t frame_index, size_t front_mandelbrot_frame_index, const mat3s* front_affine_map, size_t back_mandelbrot_frame_index, const mat3s* back_affine_map) {
+    parameters_t* parameters = parameter_data + (frame_index * MANDELBROT_PARAMETER_STRIDE);
     for (size_t i = 0; i < 3; i++) {
-        push_constants.affine_map[i].col = affine_map->col[i];
+        parameters->affine_maps[0][i].col = front_affine_map->col[i];
+        parameters->affine_maps[1][i].col = back_affine_map->col[i];
     }
 
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+    const mandelbrot_dispatch_t* front_dispatch = &mandelbrot_dispatches[front_mandelbrot_frame_index];
+    const mandelbrot_dispatch_t* back_dispatch = &mandelbrot_dispatches[back_mandelbrot_frame_index];
+    parameters->image_extents[0] = front_dispatch->width * 8;
+    parameters->image_extents[1] = front_dispatch->height * 8;
+    parameters->image_extents[2] = back_dispatch->width * 8;
+    parameters->image_extents[3] = back_dispatch->height * 8;
+
+    parameters->pending_tiles[0] = 0;
+    parameters->pending_tiles[1] = 0;
+    if (back_mandelbrot_frame_index == get_mandelbrot_back_frame_index()) {
+        get_mandelbrot_pending_cpu_tiles(&parameters->pending_tiles[0], &parameters->pending_tiles[1]);
+    }
+}
 
-    vkCmdPushConstants(command_buffer, pipeline.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push_constants), &push_constants);
+// Nothing in here changes from frame to frame, the tween maps and image extents are read from the parameter entry of frame_index
+void record_mandelbrot_render_pipeline(VkCommandBuffer command_buffer, size_t mandelbrot_frame_index, size_t frame_index, uint32_t layer) {
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
 
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline_layout, 0, 1, (VkDescriptorSet[1]) { descriptor_sets[mandelbrot_frame_index] }, 0, NULL);
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer, (VkDeviceSize[1]) { 0 });
-    vkCmdBindIndexBuffer(command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT16);
+    vkCmdPushConstants(command_buffer, pipeline.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push_constants_t), &(push_constants_t) { layer });
 
-    vkCmdDrawIndexed(command_buffer, 6, 1, 0, 0, 0);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline_layout, 0, 1, (VkDescriptorSet[1]) { descriptor_sets[mandelbrot_frame_index][descriptor_set_parities[mandelbrot_frame_index]] }, 1, (uint32_t[1]) { (uint32_t) frame_index * MANDELBROT_PARAMETER_STRIDE });
 
-    return result_success;
+    vkCmdDraw(command_buffer, 3, 1, 0, 0);
 }
 
 void term_mandelbrot_render_pipeline() {
+    vmaDestroyBuffer(allocator, parameter_buffer, parameter_buffer_allocation);
     vkDestroySampler(device, color_sampler, NULL);
-    vmaDestroyBuffer(allocator, index_buffer, index_buffer_allocation);
-    vmaDestroyBuffer(allocator, vertex_buffer, vertex_buffer_allocation);
     destroy_pipeline(&pipeline);
     vkDestroyDescriptorSetLayout(device, descriptor_set_layout, NULL);
 }
\ No newline at end of file
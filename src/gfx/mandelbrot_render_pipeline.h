@@ -1,9 +1,12 @@
 #pragma once
 #include "result.h"
 #include <cglm/types-struct.h>
+#include <stdbool.h>
 #include <vulkan/vulkan.h>
 
-result_t init_mandelbrot_render_pipeline(VkQueue queue, VkCommandBuffer command_buffer, VkFence command_fence, VkDescriptorPool descriptor_pool, const VkPhysicalDeviceProperties* physical_device_properties);
+result_t init_mandelbrot_render_pipeline(VkDescriptorPool descriptor_pool, const VkPhysicalDeviceProperties* physical_device_properties);
 void update_mandelbrot_render_pipeline(size_t frame_index);
-result_t draw_mandelbrot_render_pipeline(VkCommandBuffer command_buffer, size_t mandelbrot_frame_index, size_t render_frame_index, const mat3s* affine_map);
+uint32_t get_mandelbrot_render_pipeline_version(void);
+void write_mandelbrot_render_pipeline_parameters(size_t frame_index, size_t front_mandelbrot_frame_index, const mat3s* front_affine_map, size_t back_mandelbrot_frame_index, const mat3s* back_affine_map);
+void record_mandelbrot_render_pipeline(VkCommandBuffer command_buffer, size_t mandelbrot_frame_index, size_t frame_index, uint32_t layer);
 void term_mandelbrot_render_pipeline(void);
\ No newline at end of file
@@ -2,49 +2,89 @@
 #include "chrono.h"
 #include "gfx/gfx.h"
 #include "gfx/mandelbrot_management.h"
+#include "pacing.h"
 #include "result.h"
 #include <GLFW/glfw3.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <threads.h>
 
-int main() {
+// Set by the input thread once the window should close, or by the render thread when it fails
+static atomic_bool stopping = false;
+
+// Computing and rendering both block on the gpu, so they get their own thread and input is handled on the main thread whatever the gpu load
+// Compute scheduling stays on this thread since it shares the graphics queue and the mandelbrot frames with rendering
+static int render(void*) {
     result_t result;
-    if ((result = init_gfx()) != result_success) {
-        print_result_error(result);
-        return 1;
-    }
-    
-    init_camera();
 
     microseconds_t frame_render_time = 0;
     microseconds_t mandelbrot_frame_compute_time = 0;
+    // Of the most recent frame that showed input, kept until the next one does
+    microseconds_t input_latency = 0;
 
-    float delta = 1.0f/60.0f;
-    while (!glfwWindowShouldClose(window)) {
-        microseconds_t logic_start = get_current_microseconds();
-        glfwPollEvents();
-        update_camera(delta);
+    bool idle = false;
+    while (!atomic_load(&stopping)) {
+        pace_frame(idle);
+        latch_camera();
 
-        if ((result = draw_gfx(&frame_render_time, &mandelbrot_frame_compute_time)) != result_success) {
+        // Snapshots that change nothing, such as the cursor moving over the window, do not need a new frame
+        if (idle && is_camera_still() && is_gfx_idle()) {
+            continue;
+        }
+
+        if ((result = draw_gfx(&frame_render_time, &mandelbrot_frame_compute_time, &input_latency)) != result_success) {
             print_result_error(result);
+            atomic_store(&stopping, true);
+            glfwPostEmptyEvent();
             return 1;
         }
 
-        microseconds_t logic_end = get_current_microseconds();
-        microseconds_t logic_time = logic_end - logic_start;
+        idle = is_camera_still() && is_gfx_idle();
 
-        microseconds_t remaining_logic_time = (1000000l/glfwGetVideoMode(glfwGetPrimaryMonitor())->refreshRate) - logic_time;
-        if (remaining_logic_time > 0) {
-            sleep_microseconds(remaining_logic_time);
-        }
+        // printf("Frame render time: %ldμs, Mandelbrot frame compute time: %ldμs, Input latency: %ldμs\n", frame_render_time, mandelbrot_frame_compute_time, input_latency);
+    }
+
+    return 0;
+}
+
+int main() {
+    result_t result;
+    if ((result = init_gfx()) != result_success) {
+        print_result_error(result);
+        return 1;
+    }
 
-        logic_end = get_current_microseconds();
-        microseconds_t total_logic_time = logic_end - logic_start;
-        delta = (float) total_logic_time/1000000.0f;
+    thrd_t render_thread;
+    if (thrd_create(&render_thread, render, NULL) != thrd_success) {
+        print_result_error(result_thread_create_failure);
+        term_gfx();
+        return 1;
+    }
+
+    // While the camera eases it is updated at least once a refresh, once it is still only input can move it
+    bool still = false;
+    microseconds_t last_update_time = get_current_microseconds();
+    while (!glfwWindowShouldClose(window) && !atomic_load(&stopping)) {
+        if (still) {
+            glfwWaitEvents();
+        } else {
+            glfwWaitEventsTimeout((double) get_refresh_interval() / 1000000.0);
+        }
 
-        // printf("FPS: %f, Logic time: %ldμs, Frame render time: %ldμs, Mandelbrot frame compute time: %ldμs\n", delta, logic_time, frame_render_time, mandelbrot_frame_compute_time);
+        // The time spent waiting while still was not time the camera moved for
+        microseconds_t update_time = get_current_microseconds();
+        microseconds_t delta = still ? get_refresh_interval() : update_time - last_update_time;
+        still = update_camera((float) delta / 1000000.0f);
+        last_update_time = update_time;
     }
 
+    atomic_store(&stopping, true);
+    release_camera_waits();
+
+    int render_status;
+    thrd_join(render_thread, &render_status);
+
     term_gfx();
 
-    return 0;
-}
\ No newline at end of file
+    return render_status;
+}
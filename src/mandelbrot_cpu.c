@@ -0,0 +1,389 @@
+#include "mandelbrot_cpu.h"
+#include "mandelbrot_cpu_kernel.h"
+#include "util.h"
+#include <float.h>
+#include <math.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+__extension__ typedef _Float16 half_t;
+
+typedef struct {
+    thrd_t thread;
+    // The tiles left to the worker, the first in the low half and one past the last in the high half so that it and thieves take from either end with one compare and swap
+    alignas(64) _Atomic(uint64_t) range;
+} worker_t;
+
+static worker_t workers[MANDELBROT_CPU_MAX_WORKERS];
+static uint32_t num_workers = 0;
+
+static mtx_t mutex;
+// Broadcast with the mutex held when tiles are submitted or the workers are to stop
+static cnd_t work_condition;
+// Broadcast with the mutex held when the last tile is done
+static cnd_t done_condition;
+static uint64_t batch = 0;
+static bool stopping = false;
+
+// Only written while no tiles are left, workers read them once they have taken a tile
+static mandelbrot_cpu_frame_t frame;
+static bool single_precision = true;
+static mandelbrot_tile_t* tiles = NULL;
+static uint32_t tile_capacity = 0;
+
+static atomic_uint num_remaining_tiles = 0;
+static atomic_bool cancelled = false;
+static microseconds_t submit_time = 0;
+// The latest any worker finished a tile, which is when the last one was done once none are left
+static _Atomic(microseconds_t) done_time = 0;
+
+// Must match colors in mandelbrot_kernel.glsl
+static const float colors[16][3] = {
+    { 0.258824f, 0.117647f, 0.058824f },
+    { 0.098039f, 0.027451f, 0.101961f },
+    { 0.035294f, 0.003922f, 0.184314f },
+    { 0.015686f, 0.015686f, 0.286275f },
+    { 0.000000f, 0.027451f, 0.392157f },
+    { 0.047059f, 0.172549f, 0.541176f },
+    { 0.094118f, 0.321569f, 0.694118f },
+    { 0.223529f, 0.490196f, 0.819608f },
+    { 0.525490f, 0.709804f, 0.898039f },
+    { 0.827451f, 0.925490f, 0.972549f },
+    { 0.945098f, 0.913725f, 0.749020f },
+    { 0.972549f, 0.788235f, 0.372549f },
+    { 1.000000f, 0.666667f, 0.000000f },
+    { 0.800000f, 0.501961f, 0.000000f },
+    { 0.600000f, 0.341176f, 0.000000f },
+    { 0.415686f, 0.203922f, 0.011765f }
+};
+
+// Alpha only marks the pixel as computed, as in get_iterations_color in mandelbrot_kernel.glsl
+static void get_iterations_color(uint32_t iterations, float color[4]) {
+    if (iterations > MANDELBROT_MAX_ITERATIONS) {
+        color[0] = 0.0f;
+        color[1] = 0.0f;
+        color[2] = 0.0f;
+        color[3] = 1.0f;
+        return;
+    }
+    memcpy(color, colors[(iterations - 1) % 16], sizeof(colors[0]));
+    color[3] = 1.0f;
+}
+
+// Every pixel of the block holds the sample, as store_block_sample in mandelbrot.glsl does it
+static void store_block_sample(uint32_t pixel_x, uint32_t pixel_y, uint32_t rate, uint32_t iterations) {
+    float color[4];
+    get_iterations_color(iterations, color);
+
+    float weight = 1.0f / (float) (frame.sample_index + 1);
+    for (uint32_t y = pixel_y; y < pixel_y + rate && y < frame.image_height; y++) {
+        half_t* row = frame.pixels + (y * frame.row_pitch);
+        uint32_t* iteration_row = frame.iterations + (y * frame.iteration_row_pitch);
+        for (uint32_t x = pixel_x; x < pixel_x + rate && x < frame.image_width; x++) {
+            if (frame.sample_index == 0) {
+                iteration_row[x] = iterations;
+            }
+
+            half_t* texel = &row[4 * x];
+            for (size_t i = 0; i < 4; i++) {
+                float value = color[i];
+                if (frame.sample_index > 0) {
+                    value = ((float) texel[i] * (1.0f - weight)) + (value * weight);
+                }
+                texel[i] = (half_t) value;
+            }
+        }
+    }
+}
+
+static uint32_t get_tile_rate(const mandelbrot_cpu_frame_t* cpu_frame, const mandelbrot_tile_t* tile) {
+    uint32_t num_tiles_x = div_ceil_uint32(cpu_frame->image_width, MANDELBROT_TILE_SIZE);
+    return cpu_frame->rates == NULL ? 1 : (cpu_frame->rates[(tile->y * num_tiles_x) + tile->x] & MANDELBROT_RATE_MASK);
+}
+
+// The sample positions of a row of blocks of a tile, as get_block_position in mandelbrot.glsl has them
+static void get_block_positions(const mandelbrot_cpu_frame_t* cpu_frame, const mandelbrot_tile_t* tile, uint32_t rate, uint32_t pixel_y, double c_x[], double c_y[]) {
+    const double (*affine_map)[2] = cpu_frame->affine_map;
+
+    double sample_y = (double) pixel_y + (0.5 * (double) (rate - 1)) + ((double) cpu_frame->jitter.y * (double) rate);
+    double screen_y = (2.0 * sample_y / (double) cpu_frame->image_height) - 1.0;
+
+    for (uint32_t block_x = 0; block_x < MANDELBROT_TILE_SIZE / rate; block_x++) {
+        uint32_t pixel_x = (tile->x * MANDELBROT_TILE_SIZE) + (block_x * rate);
+        double sample_x = (double) pixel_x + (0.5 * (double) (rate - 1)) + ((double) cpu_frame->jitter.x * (double) rate);
+        double screen_x = (2.0 * sample_x / (double) cpu_frame->image_width) - 1.0;
+
+        c_x[block_x] = (affine_map[0][0] * screen_x) + (affine_map[1][0] * screen_y) + affine_map[2][0];
+        c_y[block_x] = (affine_map[0][1] * screen_x) + (affine_map[1][1] * screen_y) + affine_map[2][1];
+    }
+}
+
+// A row of blocks at a time
+static void render_tile(const mandelbrot_tile_t* tile) {
+    uint32_t rate = get_tile_rate(&frame, tile);
+    // At most 4 so a row always has a multiple of MANDELBROT_CPU_KERNEL_WIDTH blocks
+    uint32_t num_blocks = MANDELBROT_TILE_SIZE / rate;
+
+    alignas(64) double c_x[MANDELBROT_TILE_SIZE];
+    alignas(64) double c_y[MANDELBROT_TILE_SIZE];
+    alignas(64) float single_c_x[MANDELBROT_TILE_SIZE];
+    alignas(64) float single_c_y[MANDELBROT_TILE_SIZE];
+    alignas(64) uint32_t iterations[MANDELBROT_TILE_SIZE];
+
+    for (uint32_t block_y = 0; block_y < num_blocks; block_y++) {
+        uint32_t pixel_y = (tile->y * MANDELBROT_TILE_SIZE) + (block_y * rate);
+        if (pixel_y >= frame.image_height || atomic_load_explicit(&cancelled, memory_order_relaxed)) {
+            return;
+        }
+
+        get_block_positions(&frame, tile, rate, pixel_y, c_x, c_y);
+
+        if (single_precision) {
+            for (uint32_t i = 0; i < num_blocks; i++) {
+                single_c_x[i] = (float) c_x[i];
+                single_c_y[i] = (float) c_y[i];
+            }
+            mandelbrot_cpu_kernel_single(num_blocks, single_c_x, single_c_y, iterations);
+        } else {
+            mandelbrot_cpu_kernel_double(num_blocks, c_x, c_y, iterations);
+        }
+
+        for (uint32_t block_x = 0; block_x < num_blocks; block_x++) {
+            uint32_t pixel_x = (tile->x * MANDELBROT_TILE_SIZE) + (block_x * rate);
+            if (pixel_x >= frame.image_width) {
+                break;
+            }
+
+            store_block_sample(pixel_x, pixel_y, rate, iterations[block_x]);
+        }
+    }
+}
+
+// The gpu computes in single precision from a float map, so its positions are rounded to float before the reference runs on them
+bool matches_mandelbrot_cpu_reference(const mandelbrot_cpu_frame_t* cpu_frame, const mandelbrot_tile_t* tile) {
+    uint32_t rate = get_tile_rate(cpu_frame, tile);
+    uint32_t num_blocks = MANDELBROT_TILE_SIZE / rate;
+
+    double c_x[MANDELBROT_TILE_SIZE];
+    double c_y[MANDELBROT_TILE_SIZE];
+    uint32_t iterations[MANDELBROT_TILE_SIZE];
+
+    uint32_t num_checked_blocks = 0;
+    uint32_t num_mismatched_blocks = 0;
+    for (uint32_t block_y = 0; block_y < num_blocks; block_y++) {
+        uint32_t pixel_y = (tile->y * MANDELBROT_TILE_SIZE) + (block_y * rate);
+        if (pixel_y >= cpu_frame->image_height) {
+            break;
+        }
+
+        get_block_positions(cpu_frame, tile, rate, pixel_y, c_x, c_y);
+        for (uint32_t block_x = 0; block_x < num_blocks; block_x++) {
+            c_x[block_x] = (double) (float) c_x[block_x];
+            c_y[block_x] = (double) (float) c_y[block_x];
+        }
+        get_mandelbrot_cpu_reference_iterations(num_blocks, c_x, c_y, iterations);
+
+        const uint32_t* iteration_row = cpu_frame->iterations + (pixel_y * cpu_frame->iteration_row_pitch);
+        for (uint32_t block_x = 0; block_x < num_blocks; block_x++) {
+            uint32_t pixel_x = (tile->x * MANDELBROT_TILE_SIZE) + (block_x * rate);
+            if (pixel_x >= cpu_frame->image_width) {
+                break;
+            }
+
+            uint32_t difference = iteration_row[pixel_x] > iterations[block_x] ? iteration_row[pixel_x] - iterations[block_x] : iterations[block_x] - iteration_row[pixel_x];
+            num_checked_blocks++;
+            if (difference > 1) {
+                num_mismatched_blocks++;
+            }
+        }
+    }
+
+    return (float) num_mismatched_blocks <= MANDELBROT_CPU_CHECK_TOLERANCE * (float) num_checked_blocks;
+}
+
+static uint64_t pack_range(uint32_t begin, uint32_t end) {
+    return (uint64_t) begin | ((uint64_t) end << 32);
+}
+
+static bool pop_tile(worker_t* worker, uint32_t* out_tile_index) {
+    uint64_t range = atomic_load(&worker->range);
+    for (;;) {
+        uint32_t begin = (uint32_t) range;
+        uint32_t end = (uint32_t) (range >> 32);
+        if (begin >= end) {
+            return false;
+        }
+        if (atomic_compare_exchange_weak(&worker->range, &range, pack_range(begin + 1, end))) {
+            *out_tile_index = begin;
+            return true;
+        }
+    }
+}
+
+// Takes the back half of the first other worker that has tiles left, going round from the thief
+static bool steal_tile(size_t worker_index, uint32_t* out_tile_index) {
+    for (size_t i = 1; i < num_workers; i++) {
+        worker_t* victim = &workers[(worker_index + i) % num_workers];
+        uint64_t range = atomic_load(&victim->range);
+        for (;;) {
+            uint32_t begin = (uint32_t) range;
+            uint32_t end = (uint32_t) (range >> 32);
+            if (begin >= end) {
+                break;
+            }
+            uint32_t split = end - ((end - begin + 1) / 2);
+            if (atomic_compare_exchange_weak(&victim->range, &range, pack_range(begin, split))) {
+                // The thief's own range is empty so no one else changes it
+                atomic_store(&workers[worker_index].range, pack_range(split + 1, end));
+                *out_tile_index = split;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static int work(void* data) {
+    size_t worker_index = (size_t) (uintptr_t) data;
+    worker_t* worker = &workers[worker_index];
+
+    uint64_t worked_batch = 0;
+    mtx_lock(&mutex);
+    for (;;) {
+        while (!stopping && batch == worked_batch) {
+            cnd_wait(&work_condition, &mutex);
+        }
+        if (stopping) {
+            break;
+        }
+        worked_batch = batch;
+        mtx_unlock(&mutex);
+
+        uint32_t tile_index;
+        while (pop_tile(worker, &tile_index) || steal_tile(worker_index, &tile_index)) {
+            render_tile(&tiles[tile_index]);
+
+            microseconds_t time = get_current_microseconds();
+            microseconds_t latest_time = atomic_load(&done_time);
+            while (time > latest_time && !atomic_compare_exchange_weak(&done_time, &latest_time, time)) {}
+
+            if (atomic_fetch_sub(&num_remaining_tiles, 1) == 1) {
+                mtx_lock(&mutex);
+                cnd_broadcast(&done_condition);
+                mtx_unlock(&mutex);
+            }
+        }
+
+        mtx_lock(&mutex);
+    }
+    mtx_unlock(&mutex);
+
+    return 0;
+}
+
+result_t init_mandelbrot_cpu(void) {
+    init_mandelbrot_cpu_kernels();
+
+    if (mtx_init(&mutex, mtx_plain) != thrd_success || cnd_init(&work_condition) != thrd_success || cnd_init(&done_condition) != thrd_success) {
+        return result_synchronization_primitive_create_failure;
+    }
+
+    long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = clamp_uint32(num_cores > 1 ? (uint32_t) num_cores - 1 : 1, 1, MANDELBROT_CPU_MAX_WORKERS);
+
+    for (size_t i = 0; i < num_workers; i++) {
+        atomic_init(&workers[i].range, 0);
+        if (thrd_create(&workers[i].thread, work, (void*) (uintptr_t) i) != thrd_success) {
+            num_workers = (uint32_t) i;
+            return result_thread_create_failure;
+        }
+    }
+
+    printf("CPU engine: %u workers with %s kernels\n", num_workers, get_mandelbrot_cpu_kernel_name());
+
+    return result_success;
+}
+
+// Neighbouring samples have to stay apart once rounded, the largest coordinate of the frame is where they are the coarsest
+static bool is_single_precision_enough(const mandelbrot_cpu_frame_t* cpu_frame) {
+    const double (*affine_map)[2] = cpu_frame->affine_map;
+    double pixel_size = fmin(hypot(affine_map[0][0], affine_map[0][1]) * 2.0 / (double) cpu_frame->image_width, hypot(affine_map[1][0], affine_map[1][1]) * 2.0 / (double) cpu_frame->image_height);
+    double magnitude = fabs(affine_map[2][0]) + fabs(affine_map[2][1]) + fabs(affine_map[0][0]) + fabs(affine_map[0][1]) + fabs(affine_map[1][0]) + fabs(affine_map[1][1]);
+    return pixel_size >= magnitude * FLT_EPSILON * MANDELBROT_CPU_SINGLE_PRECISION_ULPS;
+}
+
+void submit_mandelbrot_cpu_tiles(const mandelbrot_cpu_frame_t* cpu_frame, uint32_t num_tiles, const mandelbrot_tile_t cpu_tiles[]) {
+    if (num_tiles == 0) {
+        return;
+    }
+
+    if (num_tiles > tile_capacity) {
+        tiles = realloc(tiles, num_tiles * sizeof(mandelbrot_tile_t));
+        tile_capacity = num_tiles;
+    }
+    memcpy(tiles, cpu_tiles, num_tiles * sizeof(mandelbrot_tile_t));
+
+    frame = *cpu_frame;
+    single_precision = is_single_precision_enough(cpu_frame);
+    atomic_store(&cancelled, false);
+    submit_time = get_current_microseconds();
+    atomic_store(&done_time, submit_time);
+    atomic_store(&num_remaining_tiles, num_tiles);
+
+    // Ranges go last, a worker that takes a tile from them sees everything above even if it was still looking for tiles of the last batch
+    for (size_t i = 0; i < num_workers; i++) {
+        uint32_t begin = (uint32_t) (((uint64_t) num_tiles * i) / num_workers);
+        uint32_t end = (uint32_t) (((uint64_t) num_tiles * (i + 1)) / num_workers);
+        atomic_store(&workers[i].range, pack_range(begin, end));
+    }
+
+    mtx_lock(&mutex);
+    batch++;
+    cnd_broadcast(&work_condition);
+    mtx_unlock(&mutex);
+}
+
+bool are_mandelbrot_cpu_tiles_done(void) {
+    return atomic_load(&num_remaining_tiles) == 0;
+}
+
+static void wait_mandelbrot_cpu_tiles(void) {
+    mtx_lock(&mutex);
+    while (atomic_load(&num_remaining_tiles) > 0) {
+        cnd_wait(&done_condition, &mutex);
+    }
+    mtx_unlock(&mutex);
+}
+
+void cancel_mandelbrot_cpu_tiles(void) {
+    atomic_store(&cancelled, true);
+}
+
+microseconds_t get_mandelbrot_cpu_tiles_time(void) {
+    return atomic_load(&done_time) - submit_time;
+}
+
+void term_mandelbrot_cpu(void) {
+    cancel_mandelbrot_cpu_tiles();
+    wait_mandelbrot_cpu_tiles();
+
+    mtx_lock(&mutex);
+    stopping = true;
+    cnd_broadcast(&work_condition);
+    mtx_unlock(&mutex);
+
+    for (size_t i = 0; i < num_workers; i++) {
+        thrd_join(workers[i].thread, NULL);
+    }
+
+    cnd_destroy(&done_condition);
+    cnd_destroy(&work_condition);
+    mtx_destroy(&mutex);
+
+    free(tiles);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "chrono.h"
+#include "gfx/mandelbrot_management.h"
+#include "result.h"
+#include <cglm/types-struct.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// One worker per core but the one rendering, up to this many
+#define MANDELBROT_CPU_MAX_WORKERS 64
+// Single precision is used as long as neighbouring pixels are at least this many of its ulps apart at the largest coordinate of the frame
+#define MANDELBROT_CPU_SINGLE_PRECISION_ULPS 16.0
+// The share of blocks of a checked tile that may be off the reference by more than an iteration, single precision wanders off near the boundary of the set
+#define MANDELBROT_CPU_CHECK_TOLERANCE 0.05f
+
+// What the workers render tiles of, laid out like the tiles of mandelbrot.comp
+typedef struct {
+    // Half float rgba as MANDELBROT_COLOR_FORMAT has it, rows are row_pitch bytes apart
+    void* pixels;
+    size_t row_pitch;
+    // Iteration counts as MANDELBROT_ITERATION_FORMAT has them, written with the first sample only
+    void* iterations;
+    size_t iteration_row_pitch;
+    // In pixels of the part of the image the frame uses
+    uint32_t image_width;
+    uint32_t image_height;
+    // The columns of the affine map from normalized image coordinates to the complex plane, see get_camera_view_double_affine_map
+    double affine_map[3][2];
+    uint32_t sample_index;
+    vec2s jitter;
+    // Samples per pixel side of each tile as in the rate buffers, or NULL for one per pixel
+    const uint32_t* rates;
+} mandelbrot_cpu_frame_t;
+
+result_t init_mandelbrot_cpu(void);
+void term_mandelbrot_cpu(void);
+
+// Returns right away, the tiles before have to be done. The tiles are copied but the pixels and rates of the frame have to stay until these are done
+void submit_mandelbrot_cpu_tiles(const mandelbrot_cpu_frame_t* frame, uint32_t num_tiles, const mandelbrot_tile_t tiles[]);
+bool are_mandelbrot_cpu_tiles_done(void);
+// Tiles that are not started are skipped and those in progress stop at their next row, they still count as done
+void cancel_mandelbrot_cpu_tiles(void);
+// From submitting the last tiles until the last of them was done, only meaningful once they are
+microseconds_t get_mandelbrot_cpu_tiles_time(void);
+// Whether the first sample of a tile of the frame, computed by anything, agrees with get_mandelbrot_cpu_reference_iterations. Takes as long as computing the tile on a single core
+bool matches_mandelbrot_cpu_reference(const mandelbrot_cpu_frame_t* frame, const mandelbrot_tile_t* tile);
@@ -0,0 +1,271 @@
+#include "mandelbrot_cpu_kernel.h"
+#include "gfx/mandelbrot_management.h"
+#include <immintrin.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+mandelbrot_cpu_kernel_single_t mandelbrot_cpu_kernel_single;
+mandelbrot_cpu_kernel_double_t mandelbrot_cpu_kernel_double;
+
+static const char* kernel_name = "scalar";
+
+// Every kernel follows get_iterations in mandelbrot_kernel.glsl, z is squared and c added before the escape test
+static void get_scalar_single_iterations(size_t num_points, const float c_x[], const float c_y[], uint32_t iterations[]) {
+    for (size_t i = 0; i < num_points; i++) {
+        float z_x = 0.0f;
+        float z_y = 0.0f;
+        iterations[i] = MANDELBROT_MAX_ITERATIONS + 1;
+        for (uint32_t j = 0; j < MANDELBROT_MAX_ITERATIONS; j++) {
+            float next_z_x = (z_x * z_x) - (z_y * z_y) + c_x[i];
+            z_y = (2.0f * z_x * z_y) + c_y[i];
+            z_x = next_z_x;
+            if ((z_x * z_x) + (z_y * z_y) >= 4.0f) {
+                iterations[i] = j + 1;
+                break;
+            }
+        }
+    }
+}
+
+void get_mandelbrot_cpu_reference_iterations(size_t num_points, const double c_x[], const double c_y[], uint32_t iterations[]) {
+    for (size_t i = 0; i < num_points; i++) {
+        double z_x = 0.0;
+        double z_y = 0.0;
+        iterations[i] = MANDELBROT_MAX_ITERATIONS + 1;
+        for (uint32_t j = 0; j < MANDELBROT_MAX_ITERATIONS; j++) {
+            double next_z_x = (z_x * z_x) - (z_y * z_y) + c_x[i];
+            z_y = (2.0 * z_x * z_y) + c_y[i];
+            z_x = next_z_x;
+            if ((z_x * z_x) + (z_y * z_y) >= 4.0) {
+                iterations[i] = j + 1;
+                break;
+            }
+        }
+    }
+}
+
+// Lanes count up for as long as they are active, lanes that escaped keep iterating with the others but their z is ignored
+// Those still active after the last iteration never escape and get one more
+__attribute__((target("avx2,fma")))
+static void get_avx2_single_iterations(size_t num_points, const float c_x[], const float c_y[], uint32_t iterations[]) {
+    for (size_t i = 0; i < num_points; i += 8) {
+        __m256 point_c_x = _mm256_loadu_ps(&c_x[i]);
+        __m256 point_c_y = _mm256_loadu_ps(&c_y[i]);
+        __m256 z_x = _mm256_setzero_ps();
+        __m256 z_y = _mm256_setzero_ps();
+        __m256i counts = _mm256_setzero_si256();
+        __m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        __m256 escape = _mm256_set1_ps(4.0f);
+
+        for (uint32_t j = 0; j < MANDELBROT_MAX_ITERATIONS; j++) {
+            __m256 z_xy = _mm256_mul_ps(z_x, z_y);
+            z_x = _mm256_add_ps(_mm256_fmsub_ps(z_x, z_x, _mm256_mul_ps(z_y, z_y)), point_c_x);
+            z_y = _mm256_add_ps(_mm256_add_ps(z_xy, z_xy), point_c_y);
+
+            // Active lanes are all ones, which is -1
+            counts = _mm256_sub_epi32(counts, _mm256_castps_si256(active));
+
+            __m256 modulus = _mm256_fmadd_ps(z_x, z_x, _mm256_mul_ps(z_y, z_y));
+            active = _mm256_and_ps(active, _mm256_cmp_ps(modulus, escape, _CMP_LT_OQ));
+            if (_mm256_testz_ps(active, active)) {
+                break;
+            }
+        }
+
+        counts = _mm256_sub_epi32(counts, _mm256_castps_si256(active));
+        _mm256_storeu_si256((__m256i*) &iterations[i], counts);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void get_avx2_double_iterations(size_t num_points, const double c_x[], const double c_y[], uint32_t iterations[]) {
+    for (size_t i = 0; i < num_points; i += 4) {
+        __m256d point_c_x = _mm256_loadu_pd(&c_x[i]);
+        __m256d point_c_y = _mm256_loadu_pd(&c_y[i]);
+        __m256d z_x = _mm256_setzero_pd();
+        __m256d z_y = _mm256_setzero_pd();
+        __m256i counts = _mm256_setzero_si256();
+        __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        __m256d escape = _mm256_set1_pd(4.0);
+
+        for (uint32_t j = 0; j < MANDELBROT_MAX_ITERATIONS; j++) {
+            __m256d z_xy = _mm256_mul_pd(z_x, z_y);
+            z_x = _mm256_add_pd(_mm256_fmsub_pd(z_x, z_x, _mm256_mul_pd(z_y, z_y)), point_c_x);
+            z_y = _mm256_add_pd(_mm256_add_pd(z_xy, z_xy), point_c_y);
+
+            counts = _mm256_sub_epi64(counts, _mm256_castpd_si256(active));
+
+            __m256d modulus = _mm256_fmadd_pd(z_x, z_x, _mm256_mul_pd(z_y, z_y));
+            active = _mm256_and_pd(active, _mm256_cmp_pd(modulus, escape, _CMP_LT_OQ));
+            if (_mm256_testz_pd(active, active)) {
+                break;
+            }
+        }
+
+        counts = _mm256_sub_epi64(counts, _mm256_castpd_si256(active));
+
+        // Counts fit in the low half of every lane
+        uint64_t lane_counts[4];
+        _mm256_storeu_si256((__m256i*) lane_counts, counts);
+        for (size_t j = 0; j < 4; j++) {
+            iterations[i + j] = (uint32_t) lane_counts[j];
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void get_avx512_single_iterations(size_t num_points, const float c_x[], const float c_y[], uint32_t iterations[]) {
+    for (size_t i = 0; i < num_points; i += 16) {
+        __m512 point_c_x = _mm512_loadu_ps(&c_x[i]);
+        __m512 point_c_y = _mm512_loadu_ps(&c_y[i]);
+        __m512 z_x = _mm512_setzero_ps();
+        __m512 z_y = _mm512_setzero_ps();
+        __m512i counts = _mm512_setzero_si512();
+        __m512i one = _mm512_set1_epi32(1);
+        __mmask16 active = 0xffff;
+        __m512 escape = _mm512_set1_ps(4.0f);
+
+        for (uint32_t j = 0; j < MANDELBROT_MAX_ITERATIONS; j++) {
+            __m512 z_xy = _mm512_mul_ps(z_x, z_y);
+            z_x = _mm512_add_ps(_mm512_fmsub_ps(z_x, z_x, _mm512_mul_ps(z_y, z_y)), point_c_x);
+            z_y = _mm512_add_ps(_mm512_add_ps(z_xy, z_xy), point_c_y);
+
+            counts = _mm512_mask_add_epi32(counts, active, counts, one);
+
+            __m512 modulus = _mm512_fmadd_ps(z_x, z_x, _mm512_mul_ps(z_y, z_y));
+            active = _mm512_mask_cmp_ps_mask(active, modulus, escape, _CMP_LT_OQ);
+            if (active == 0) {
+                break;
+            }
+        }
+
+        counts = _mm512_mask_add_epi32(counts, active, counts, one);
+        _mm512_storeu_si512(&iterations[i], counts);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void get_avx512_double_iterations(size_t num_points, const double c_x[], const double c_y[], uint32_t iterations[]) {
+    for (size_t i = 0; i < num_points; i += 8) {
+        __m512d point_c_x = _mm512_loadu_pd(&c_x[i]);
+        __m512d point_c_y = _mm512_loadu_pd(&c_y[i]);
+        __m512d z_x = _mm512_setzero_pd();
+        __m512d z_y = _mm512_setzero_pd();
+        __m512i counts = _mm512_setzero_si512();
+        __m512i one = _mm512_set1_epi64(1);
+        __mmask8 active = 0xff;
+        __m512d escape = _mm512_set1_pd(4.0);
+
+        for (uint32_t j = 0; j < MANDELBROT_MAX_ITERATIONS; j++) {
+            __m512d z_xy = _mm512_mul_pd(z_x, z_y);
+            z_x = _mm512_add_pd(_mm512_fmsub_pd(z_x, z_x, _mm512_mul_pd(z_y, z_y)), point_c_x);
+            z_y = _mm512_add_pd(_mm512_add_pd(z_xy, z_xy), point_c_y);
+
+            counts = _mm512_mask_add_epi64(counts, active, counts, one);
+
+            __m512d modulus = _mm512_fmadd_pd(z_x, z_x, _mm512_mul_pd(z_y, z_y));
+            active = _mm512_mask_cmp_pd_mask(active, modulus, escape, _CMP_LT_OQ);
+            if (active == 0) {
+                break;
+            }
+        }
+
+        counts = _mm512_mask_add_epi64(counts, active, counts, one);
+        _mm256_storeu_si256((__m256i*) &iterations[i], _mm512_cvtepi64_epi32(counts));
+    }
+}
+
+// Points inside the set, points that escape at once and points that take a few dozen iterations, none close enough to the boundary for rounding to decide where they land
+static const double check_points[MANDELBROT_CPU_KERNEL_WIDTH][2] = {
+    { 0.0, 0.0 },
+    { -0.5, 0.0 },
+    { -1.0, 0.1 },
+    { -0.1, 0.1 },
+    { -0.12, 0.75 },
+    { 0.25, 0.25 },
+    { 2.0, 0.0 },
+    { 1.0, 1.0 },
+    { -2.0, 1.0 },
+    { 0.5, 0.5 },
+    { 0.3, 0.0 },
+    { 0.26, 0.0 },
+    { -0.75, 0.2 },
+    { 0.4, 0.3 },
+    { -1.5, 0.5 },
+    { 0.0, 1.1 }
+};
+
+// Double precision has to match the reference exactly, single precision only within this many iterations of it
+#define CHECK_SINGLE_TOLERANCE 1
+
+// Runs the kernels picked by init_mandelbrot_cpu_kernels over check_points and compares them with get_mandelbrot_cpu_reference_iterations
+static bool check_mandelbrot_cpu_kernels(void) {
+    double c_x[MANDELBROT_CPU_KERNEL_WIDTH];
+    double c_y[MANDELBROT_CPU_KERNEL_WIDTH];
+    float single_c_x[MANDELBROT_CPU_KERNEL_WIDTH];
+    float single_c_y[MANDELBROT_CPU_KERNEL_WIDTH];
+    double rounded_c_x[MANDELBROT_CPU_KERNEL_WIDTH];
+    double rounded_c_y[MANDELBROT_CPU_KERNEL_WIDTH];
+    for (size_t i = 0; i < MANDELBROT_CPU_KERNEL_WIDTH; i++) {
+        c_x[i] = check_points[i][0];
+        c_y[i] = check_points[i][1];
+        single_c_x[i] = (float) c_x[i];
+        single_c_y[i] = (float) c_y[i];
+        // The single precision kernel is compared on the points it actually gets, so only its arithmetic is checked
+        rounded_c_x[i] = (double) single_c_x[i];
+        rounded_c_y[i] = (double) single_c_y[i];
+    }
+
+    uint32_t reference_iterations[MANDELBROT_CPU_KERNEL_WIDTH];
+    uint32_t iterations[MANDELBROT_CPU_KERNEL_WIDTH];
+
+    get_mandelbrot_cpu_reference_iterations(MANDELBROT_CPU_KERNEL_WIDTH, c_x, c_y, reference_iterations);
+    mandelbrot_cpu_kernel_double(MANDELBROT_CPU_KERNEL_WIDTH, c_x, c_y, iterations);
+    for (size_t i = 0; i < MANDELBROT_CPU_KERNEL_WIDTH; i++) {
+        if (iterations[i] != reference_iterations[i]) {
+            return false;
+        }
+    }
+
+    get_mandelbrot_cpu_reference_iterations(MANDELBROT_CPU_KERNEL_WIDTH, rounded_c_x, rounded_c_y, reference_iterations);
+    mandelbrot_cpu_kernel_single(MANDELBROT_CPU_KERNEL_WIDTH, single_c_x, single_c_y, iterations);
+    for (size_t i = 0; i < MANDELBROT_CPU_KERNEL_WIDTH; i++) {
+        uint32_t difference = iterations[i] > reference_iterations[i] ? iterations[i] - reference_iterations[i] : reference_iterations[i] - iterations[i];
+        if (difference > CHECK_SINGLE_TOLERANCE) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void init_mandelbrot_cpu_kernels(void) {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        mandelbrot_cpu_kernel_single = get_avx512_single_iterations;
+        mandelbrot_cpu_kernel_double = get_avx512_double_iterations;
+        kernel_name = "AVX-512";
+    } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        mandelbrot_cpu_kernel_single = get_avx2_single_iterations;
+        mandelbrot_cpu_kernel_double = get_avx2_double_iterations;
+        kernel_name = "AVX2";
+    } else {
+        mandelbrot_cpu_kernel_single = get_scalar_single_iterations;
+        mandelbrot_cpu_kernel_double = get_mandelbrot_cpu_reference_iterations;
+        kernel_name = "scalar";
+    }
+
+    // A vector kernel that disagrees with the reference is not trusted with any tiles
+    if (!check_mandelbrot_cpu_kernels()) {
+        printf("CPU engine: %s kernels disagree with the reference, falling back to scalar ones\n", kernel_name);
+        mandelbrot_cpu_kernel_single = get_scalar_single_iterations;
+        mandelbrot_cpu_kernel_double = get_mandelbrot_cpu_reference_iterations;
+        kernel_name = "scalar";
+    }
+}
+
+const char* get_mandelbrot_cpu_kernel_name(void) {
+    return kernel_name;
+}
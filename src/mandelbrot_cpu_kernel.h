@@ -0,0 +1,21 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Points are passed in multiples of the widest vector, 16 single precision lanes of AVX-512
+#define MANDELBROT_CPU_KERNEL_WIDTH 16
+
+// Iteration counts as get_iterations in mandelbrot_kernel.glsl has them, the iteration at which c escapes offset by one and MANDELBROT_MAX_ITERATIONS + 1 if it never does
+// The points are structures of arrays, the real parts in c_x and the imaginary parts in c_y
+typedef void (*mandelbrot_cpu_kernel_single_t)(size_t num_points, const float c_x[], const float c_y[], uint32_t iterations[]);
+typedef void (*mandelbrot_cpu_kernel_double_t)(size_t num_points, const double c_x[], const double c_y[], uint32_t iterations[]);
+
+// The widest the cpu supports, picked by init_mandelbrot_cpu_kernels
+extern mandelbrot_cpu_kernel_single_t mandelbrot_cpu_kernel_single;
+extern mandelbrot_cpu_kernel_double_t mandelbrot_cpu_kernel_double;
+
+void init_mandelbrot_cpu_kernels(void);
+const char* get_mandelbrot_cpu_kernel_name(void);
+
+// Plain scalar double precision, the vector kernels are checked against it by init_mandelbrot_cpu_kernels
+void get_mandelbrot_cpu_reference_iterations(size_t num_points, const double c_x[], const double c_y[], uint32_t iterations[]);
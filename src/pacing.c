@@ -0,0 +1,105 @@
+#include "pacing.h"
+#include "camera.h"
+#include "chrono.h"
+#include "gfx/gfx.h"
+#include <GLFW/glfw3.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Assumed until the monitor the window is on is known
+#define DEFAULT_REFRESH_RATE 60
+
+// Written by the input thread when the window moves, read by both
+static _Atomic(microseconds_t) refresh_interval = 1000000l/DEFAULT_REFRESH_RATE;
+
+// Only touched by the render thread. Frames are started on a fixed grid rather than a fixed time after the last one, so sleeping never drifts
+static microseconds_t next_frame_time;
+
+static int get_overlap(int a_min, int a_max, int b_min, int b_max) {
+    int min = a_min > b_min ? a_min : b_min;
+    int max = a_max < b_max ? a_max : b_max;
+    return max > min ? max - min : 0;
+}
+
+// The monitor the window covers the most of, glfwGetWindowMonitor only knows about fullscreen windows
+static const GLFWvidmode* get_window_video_mode(void) {
+    int window_x;
+    int window_y;
+    int window_width;
+    int window_height;
+    glfwGetWindowPos(window, &window_x, &window_y);
+    glfwGetWindowSize(window, &window_width, &window_height);
+
+    int num_monitors;
+    GLFWmonitor** monitors = glfwGetMonitors(&num_monitors);
+
+    const GLFWvidmode* best_video_mode = NULL;
+    int best_area = -1;
+    for (int i = 0; i < num_monitors; i++) {
+        const GLFWvidmode* video_mode = glfwGetVideoMode(monitors[i]);
+        if (video_mode == NULL) {
+            continue;
+        }
+
+        int monitor_x;
+        int monitor_y;
+        glfwGetMonitorPos(monitors[i], &monitor_x, &monitor_y);
+
+        int area = get_overlap(window_x, window_x + window_width, monitor_x, monitor_x + video_mode->width) * get_overlap(window_y, window_y + window_height, monitor_y, monitor_y + video_mode->height);
+        if (area > best_area) {
+            best_area = area;
+            best_video_mode = video_mode;
+        }
+    }
+
+    return best_video_mode;
+}
+
+// Taken from the video mode rather than measured, frame times only track the refresh rate while frames keep up with it
+static void update_refresh_interval(void) {
+    const GLFWvidmode* video_mode = get_window_video_mode();
+    if (video_mode != NULL && video_mode->refreshRate > 0) {
+        refresh_interval = 1000000l/video_mode->refreshRate;
+    }
+}
+
+static void window_move(GLFWwindow*, int, int) {
+    update_refresh_interval();
+}
+
+void init_pacing(void) {
+    update_refresh_interval();
+    glfwSetWindowPosCallback(window, window_move);
+
+    next_frame_time = get_current_microseconds();
+}
+
+// Events are handled by the input thread, so nothing here ever polls them
+void pace_frame(bool idle) {
+    if (idle) {
+        // Nothing is moving or being computed, so nothing is drawn until the camera changes
+        wait_camera();
+    } else if (!is_gfx_present_throttled()) {
+        // A throttled swapchain already holds each frame back until a refresh, sleeping on top of it would only add latency
+        microseconds_t remaining_time = next_frame_time - get_current_microseconds();
+        if (remaining_time > 0) {
+            sleep_microseconds(remaining_time);
+        }
+    }
+
+    microseconds_t frame_time = get_current_microseconds();
+    if (idle) {
+        next_frame_time = frame_time;
+    }
+
+    // A frame that started late does not make the following ones start early to catch up
+    next_frame_time += refresh_interval;
+    if (next_frame_time < frame_time) {
+        next_frame_time = frame_time;
+    }
+}
+
+microseconds_t get_refresh_interval(void) {
+    return refresh_interval;
+}
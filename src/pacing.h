@@ -0,0 +1,13 @@
+#pragma once
+#include "chrono.h"
+#include <stdbool.h>
+
+// The most latency the present mode may add on top of rendering a frame, see get_present_mode in gfx.c
+// Just over two refreshes at 60Hz, so that FIFO with its queue full still meets it there
+#define PACING_TARGET_LATENCY 35000l
+
+// Called by init_gfx on the input thread once the window exists, before the present mode is picked
+void init_pacing(void);
+// Called by the render thread, waits until the next frame should start, or when idle until the camera changes
+void pace_frame(bool idle);
+microseconds_t get_refresh_interval(void);
@@ -51,6 +51,7 @@ static const char* get_result_string(result_t result) {
         case result_extension_support_unavailable: return "Failed to get a supported extension";
 
         case result_glfw_init_failure: return "Failed to initialize GLFW";
+        case result_thread_create_failure: return "Failed to create thread";
 
         default: return NULL;
     }
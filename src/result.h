@@ -49,7 +49,8 @@ typedef enum {
     result_suitable_physical_device_unavailable,
     result_extension_support_unavailable,
 
-    result_glfw_init_failure
+    result_glfw_init_failure,
+    result_thread_create_failure
 } result_t;
 
 void print_result_error(result_t result);